@@ -0,0 +1,201 @@
+#include "batch_parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+using std::unique_ptr;
+
+struct BatchTask {
+  int sentence_;
+  // 0: the whole sentence, 1: start of a split sentence (word row),
+  // >= 2: the cells [begin_, end_) of that row of a split sentence
+  int length_;
+  int begin_;
+  int end_;
+};
+
+struct WorkerQueue {
+  std::mutex mutex_;
+  std::deque<BatchTask> tasks_;
+
+  bool Pop(BatchTask& task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tasks_.empty()) return false;
+    task = tasks_.front();
+    tasks_.pop_front();
+    return true;
+  }
+};
+
+// Chart of a sentence that is parsed row by row
+struct SplitSentence {
+  unique_ptr<DenseParser> parser_;
+  // Tiles of the current row that are not done yet
+  std::atomic<int> remaining_tiles_;
+  std::atomic<bool> stopped_;
+};
+
+BatchParser::BatchParser(IndexedGrammar const& grammar,
+                         BatchOptions const& options)
+    : grammar_(grammar), options_(options) {
+  options_.tile_cells_ = std::max(1, options_.tile_cells_);
+}
+
+void BatchParser::Parse(vector<vector<string> > const& sentences,
+                        vector<pTreeProb>& results, vector<char>* partial) {
+  vector<vector<string_view> > views;
+  for (vector<string> const& sentence : sentences) {
+    views.emplace_back(sentence.begin(), sentence.end());
+  }
+  Parse(views, results, partial);
+}
+
+void BatchParser::Parse(vector<vector<string_view> > const& sentences,
+                        vector<pTreeProb>& results, vector<char>* partial) {
+  auto start_time = std::chrono::steady_clock::now();
+  stats_ = BatchStats();
+  int n = sentences.size();
+  results.assign(n, pTreeProb(nullptr, -INFINITY));
+  vector<char> partial_flags(n, 0);
+  int n_threads = options_.threads_;
+  if (n_threads <= 0) n_threads = std::thread::hardware_concurrency();
+  n_threads = std::max(1, std::min(n_threads, n));
+
+  // Longest first, each to the worker with the least estimated work
+  vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&sentences](int a, int b) {
+    return sentences[a].size() > sentences[b].size();
+  });
+  vector<WorkerQueue> queues(n_threads);
+  vector<double> load(n_threads, 0);
+  vector<unique_ptr<SplitSentence> > splits(n);
+  for (int s : order) {
+    double length = sentences[s].size();
+    int w = std::min_element(load.begin(), load.end()) - load.begin();
+    load[w] += length * length * length;
+    bool split = options_.split_length_ > 0 && length >= 2 &&
+                 length >= options_.split_length_;
+    if (split) {
+      splits[s].reset(new SplitSentence());
+      splits[s]->parser_.reset(new DenseParser(grammar_));
+      splits[s]->parser_->SetBudget(options_.max_seconds_, 0);
+      splits[s]->remaining_tiles_ = 0;
+      splits[s]->stopped_ = false;
+      stats_.split_sentences_++;
+    }
+    queues[w].tasks_.push_back({s, split ? 1 : 0, 0, 0});
+  }
+
+  std::atomic<int> left(n);
+  std::atomic<long> n_tasks(0), n_steals(0);
+
+  // Workers that find every queue empty sleep until new tasks are pushed
+  // or the last sentence is done. pushes counts both (it only changes
+  // under idle_mutex); a worker reads it before looking at the queues, so it
+  // cannot miss one that happens while it looks.
+  std::mutex idle_mutex;
+  std::condition_variable idle;
+  std::atomic<long> pushes(0);
+  auto wake = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex);
+      pushes++;
+    }
+    idle.notify_all();
+  };
+  auto finish_sentence = [&]() {
+    if (--left == 0) wake();
+  };
+
+  // Puts the tiles of row length of split sentence s in front of the queue
+  // of worker w, or finishes the sentence
+  auto schedule = [&](int w, int s, int length) {
+    SplitSentence& split = *splits[s];
+    DenseParser& chart = *split.parser_;
+    int n_tokens = chart.num_tokens();
+    if (length > n_tokens || split.stopped_) {
+      results[s] = chart.FinishChart(split.stopped_);
+      partial_flags[s] = chart.partial();
+      split.parser_.reset();
+      finish_sentence();
+      return;
+    }
+    int n_cells = n_tokens - length + 1;
+    int n_tiles = (n_cells + options_.tile_cells_ - 1) / options_.tile_cells_;
+    split.remaining_tiles_ = n_tiles;
+    {
+      std::lock_guard<std::mutex> lock(queues[w].mutex_);
+      for (int tile = n_tiles - 1; tile >= 0; tile--) {
+        int begin = tile * options_.tile_cells_;
+        int end = std::min(begin + options_.tile_cells_, n_cells);
+        queues[w].tasks_.push_front({s, length, begin, end});
+      }
+    }
+    // The worker that pushed takes one tile itself
+    if (n_tiles > 1) wake();
+  };
+
+  auto work = [&](int w) {
+    DenseParser parser(grammar_);
+    parser.SetBudget(options_.max_seconds_, 0);
+    BatchTask task;
+    while (left > 0) {
+      long seen = pushes;
+      bool found = queues[w].Pop(task);
+      for (int k = 1; !found && k < n_threads; k++) {
+        found = queues[(w + k) % n_threads].Pop(task);
+        if (found) n_steals++;
+      }
+      if (!found) {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle.wait(lock, [&]() { return pushes != seen || left == 0; });
+        continue;
+      }
+      n_tasks++;
+      int s = task.sentence_;
+      if (task.length_ == 0) {
+        results[s] = parser.Parse(sentences[s]);
+        partial_flags[s] = parser.partial();
+        finish_sentence();
+        continue;
+      }
+      SplitSentence& split = *splits[s];
+      if (task.length_ == 1) {
+        split.parser_->StartChart(sentences[s]);
+        schedule(w, s, 2);
+        continue;
+      }
+      if (!split.stopped_) {
+        if (split.parser_->ChartOverBudget()) {
+          split.stopped_ = true;
+        } else {
+          split.parser_->FillRow(task.length_, task.begin_, task.end_, parser);
+        }
+      }
+      // The last tile of a row starts the next one
+      if (split.remaining_tiles_.fetch_sub(1) == 1) {
+        schedule(w, s, task.length_ + 1);
+      }
+    }
+  };
+
+  vector<std::thread> threads;
+  for (int w = 1; w < n_threads; w++) threads.emplace_back(work, w);
+  if (n > 0) work(0);
+  for (std::thread& thread : threads) thread.join();
+
+  if (partial != nullptr) partial->swap(partial_flags);
+  stats_.tasks_ = n_tasks;
+  stats_.steals_ = n_steals;
+  stats_.seconds_ = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+}
@@ -0,0 +1,70 @@
+#ifndef BATCH_PARSER_H
+#define BATCH_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dense_parser.h"
+#include "indexed_grammar.h"
+#include "tree.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+struct BatchOptions {
+  // Worker threads, 0 = one per core
+  int threads_ = 0;
+  // Sentences with at least this many tokens are parsed row by row, in
+  // tiles that other workers can steal; 0 = never split
+  int split_length_ = 30;
+  // Cells per tile
+  int tile_cells_ = 4;
+  // Time budget per sentence (see DenseParser::SetBudget), 0 = none
+  double max_seconds_ = 0;
+};
+
+struct BatchStats {
+  long tasks_ = 0;
+  long steals_ = 0;
+  int split_sentences_ = 0;
+  double seconds_ = 0;
+};
+
+// Parses a batch of sentences of mixed lengths on several threads.
+// Parse cost grows with n^3, so a batch with a few long sentences is
+// finished by the thread that happens to get the longest one, unless the
+// work is balanced:
+// - the sentences are dealt out longest first by estimated cost (n^3),
+//   each one to the worker with the least work so far,
+// - long sentences are split into tasks of a few cells of one chart row
+//   (a row can only start when the row below is complete), which the
+//   worker that completes a row puts in front of its queue,
+// - a worker without work steals from the front of another worker's queue,
+//   where the work on the critical path (rows of long sentences, then the
+//   longest sentences) is, and sleeps when there is nothing to steal until
+//   new tiles are pushed.
+// Without a time budget, the trees do not depend on the number of threads
+// or the splitting.
+class BatchParser {
+ public:
+  BatchParser(IndexedGrammar const& grammar, BatchOptions const& options);
+
+  // results[i] is the parse of sentences[i] (see DenseParser::Parse),
+  // partial (if given) tells which parses are partial
+  void Parse(vector<vector<string_view> > const& sentences,
+             vector<pTreeProb>& results, vector<char>* partial = nullptr);
+  void Parse(vector<vector<string> > const& sentences,
+             vector<pTreeProb>& results, vector<char>* partial = nullptr);
+
+  // Statistics of the last Parse
+  BatchStats const& stats() const { return stats_; }
+
+ private:
+  IndexedGrammar const& grammar_;
+  BatchOptions options_;
+  BatchStats stats_;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using std::vector;
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's
+// array queue). Every slot carries a sequence number that tells producers
+// and consumers whether it is free or full for their position, so a push
+// or pop is one compare-and-swap on the position plus one store.
+//
+// Push blocks while the queue is full, which gives backpressure to the
+// producers. Pop blocks while the queue is empty and returns false once the
+// queue is closed and drained. A blocked thread spins, then yields, then
+// sleeps on a condition variable until a push, pop or Close wakes it up, so
+// a stage that waits for a long time does not burn a core. The lock is
+// only taken while a thread sleeps.
+template <typename T>
+class BoundedQueue {
+ public:
+  // capacity is rounded up to a power of two
+  BoundedQueue(size_t capacity);
+
+  bool TryPush(T& value);
+  bool TryPop(T& value);
+  void Push(T value);
+  bool Pop(T& value);
+  // No more pushes will follow
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    Notify();
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence_;
+    T value_;
+  };
+
+  vector<Slot> slots_;
+  size_t mask_;
+  // Producers and consumers on separate cache lines
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+  alignas(64) std::atomic<bool> closed_;
+  // Threads sleeping in Await
+  std::atomic<int> sleepers_;
+  // Counts the notifications, guarded by mutex_
+  long epoch_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+
+  // Blocks until ready() returns true
+  template <typename F>
+  void Await(F ready);
+  // Wakes up sleeping threads after a push, a pop or Close
+  void Notify();
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+    : head_(0), tail_(0), closed_(false), sleepers_(0), epoch_(0) {
+  size_t size = 2;
+  while (size < capacity) size *= 2;
+  slots_ = vector<Slot>(size);
+  for (size_t i = 0; i < size; i++) {
+    slots_[i].sequence_.store(i, std::memory_order_relaxed);
+  }
+  mask_ = size - 1;
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPush(T& value) {
+  size_t position = head_.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[position & mask_];
+    size_t sequence = slot->sequence_.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // full
+    } else {
+      position = head_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->value_ = std::move(value);
+  slot->sequence_.store(position + 1, std::memory_order_release);
+  Notify();
+  return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPop(T& value) {
+  size_t position = tail_.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[position & mask_];
+    size_t sequence = slot->sequence_.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // empty
+    } else {
+      position = tail_.load(std::memory_order_relaxed);
+    }
+  }
+  value = std::move(slot->value_);
+  slot->sequence_.store(position + mask_ + 1, std::memory_order_release);
+  Notify();
+  return true;
+}
+
+template <typename T>
+void BoundedQueue<T>::Push(T value) {
+  Await([&] { return TryPush(value); });
+}
+
+template <typename T>
+bool BoundedQueue<T>::Pop(T& value) {
+  bool popped = false;
+  Await([&] {
+    if (TryPop(value)) return popped = true;
+    // Pushes before Close are visible after it, so one more try suffices
+    if (!closed_.load(std::memory_order_acquire)) return false;
+    popped = TryPop(value);
+    return true;
+  });
+  return popped;
+}
+
+template <typename T>
+template <typename F>
+void BoundedQueue<T>::Await(F ready) {
+  for (int round = 0; round < 128; round++) {
+    if (ready()) return;
+    if (round >= 64) std::this_thread::yield();
+  }
+  // Either Notify sees the new sleeper, or the queue change it reports is
+  // visible to ready() below (both sides fence between their store and
+  // their load). A change that ready() missed bumps epoch_ after it was
+  // read, so the wait cannot miss the notification.
+  sleepers_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (true) {
+    long epoch;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      epoch = epoch_;
+    }
+    if (ready()) break;
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&] { return epoch_ != epoch; });
+  }
+  sleepers_.fetch_sub(1);
+}
+
+template <typename T>
+void BoundedQueue<T>::Notify() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    epoch_++;
+    changed_.notify_all();
+  }
+}
+
+#endif
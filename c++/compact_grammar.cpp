@@ -0,0 +1,375 @@
+#include "compact_grammar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <string_view>
+#include <utility>
+
+static const char kMagic[8] = {'P', 'C', 'F', 'G', 'C', 'M', 'P', '1'};
+
+CompactGrammar::CompactGrammar(IndexedGrammar const& grammar,
+                               LOG_PROB_PRECISION precision) {
+  precision_ = precision;
+  root_ = grammar.root_;
+  unknown_word_ = grammar.unknown_word_;
+  n_non_terms_ = grammar.num_non_terms();
+  n_pos_tags_ = grammar.num_pos_tags();
+  n_words_ = grammar.num_words();
+
+  for (vector<string> const* names :
+       {&grammar.non_terms_, &grammar.pos_tags_, &grammar.words_}) {
+    for (string const& name : *names) {
+      name_offsets_.push_back(name_pool_.size());
+      name_pool_ += name;
+    }
+  }
+  name_offsets_.push_back(name_pool_.size());
+
+  lexicon_offsets_.assign(grammar.lexicon_offsets_.begin(),
+                          grammar.lexicon_offsets_.end());
+  lexicon_pos_.assign(grammar.lexicon_pos_.begin(), grammar.lexicon_pos_.end());
+  unary_offsets_.assign(grammar.unary_offsets_.begin(),
+                        grammar.unary_offsets_.end());
+  unary_parent_.assign(grammar.unary_parent_.begin(),
+                       grammar.unary_parent_.end());
+  binary_parent_.assign(grammar.binary_parent_.begin(),
+                        grammar.binary_parent_.end());
+  binary_left_.assign(grammar.binary_left_.begin(), grammar.binary_left_.end());
+  binary_right_.assign(grammar.binary_right_.begin(),
+                       grammar.binary_right_.end());
+  left_offsets_.assign(grammar.left_offsets_.begin(),
+                       grammar.left_offsets_.end());
+
+  // The quantization grid spans the smallest log probability up to 0
+  min_log_prob_ = 0;
+  for (vector<float> const* log_probs :
+       {&grammar.lexicon_log_probs_, &grammar.unary_log_probs_,
+        &grammar.binary_log_probs_}) {
+    for (float log_prob : *log_probs) {
+      min_log_prob_ = std::min(min_log_prob_, log_prob);
+    }
+  }
+  log_prob_step_ = min_log_prob_ < 0 ? -min_log_prob_ / 65535 : 1;
+  AppendLogProbs(grammar.lexicon_log_probs_);
+  AppendLogProbs(grammar.unary_log_probs_);
+  AppendLogProbs(grammar.binary_log_probs_);
+}
+
+void CompactGrammar::AppendLogProbs(vector<float> const& log_probs) {
+  for (float log_prob : log_probs) {
+    if (precision_ == PRECISION_FLOAT) {
+      log_probs_.push_back(log_prob);
+    } else {
+      long code = std::lround((log_prob - min_log_prob_) / log_prob_step_);
+      code = std::max(0L, std::min(65535L, code));
+      log_prob_codes_.push_back(code);
+    }
+  }
+}
+
+float CompactGrammar::LogProb(size_t index) const {
+  if (precision_ == PRECISION_FLOAT) return log_probs_[index];
+  return min_log_prob_ + log_prob_codes_[index] * log_prob_step_;
+}
+
+string CompactGrammar::Name(uint32_t index) const {
+  return name_pool_.substr(name_offsets_[index],
+                           name_offsets_[index + 1] - name_offsets_[index]);
+}
+
+IndexedGrammar CompactGrammar::Expand() const {
+  IndexedGrammar g;
+  g.root_ = root_;
+  g.unknown_word_ = unknown_word_;
+  uint32_t index = 0;
+  for (uint32_t i = 0; i < n_non_terms_; i++, index++) {
+    g.non_terms_.push_back(Name(index));
+    g.non_term_ids_[g.non_terms_.back()] = i;
+  }
+  for (uint32_t i = 0; i < n_pos_tags_; i++, index++) {
+    g.pos_tags_.push_back(Name(index));
+    g.pos_tag_ids_[g.pos_tags_.back()] = i;
+  }
+  for (uint32_t i = 0; i < n_words_; i++, index++) {
+    g.words_.push_back(Name(index));
+    g.word_ids_[g.words_.back()] = i;
+  }
+  g.BuildWordIndex();
+
+  g.lexicon_offsets_.assign(lexicon_offsets_.begin(), lexicon_offsets_.end());
+  g.lexicon_pos_.assign(lexicon_pos_.begin(), lexicon_pos_.end());
+  g.unary_offsets_.assign(unary_offsets_.begin(), unary_offsets_.end());
+  g.unary_parent_.assign(unary_parent_.begin(), unary_parent_.end());
+  g.binary_parent_.assign(binary_parent_.begin(), binary_parent_.end());
+  g.binary_left_.assign(binary_left_.begin(), binary_left_.end());
+  g.binary_right_.assign(binary_right_.begin(), binary_right_.end());
+  g.left_offsets_.assign(left_offsets_.begin(), left_offsets_.end());
+
+  size_t p = 0;
+  for (size_t i = 0; i < lexicon_pos_.size(); i++) {
+    g.lexicon_log_probs_.push_back(LogProb(p++));
+  }
+  for (size_t i = 0; i < unary_parent_.size(); i++) {
+    g.unary_log_probs_.push_back(LogProb(p++));
+  }
+  for (size_t i = 0; i < binary_parent_.size(); i++) {
+    g.binary_log_probs_.push_back(LogProb(p++));
+  }
+  return g;
+}
+
+// Offsets must start at 0, never decrease and end at the size of the
+// array they index into
+static bool ValidOffsets(vector<uint32_t> const& offsets, size_t n_groups,
+                         size_t n_entries) {
+  if (offsets.size() != n_groups + 1 || offsets[0] != 0) return false;
+  for (size_t i = 0; i < n_groups; i++) {
+    if (offsets[i] > offsets[i + 1]) return false;
+  }
+  return offsets.back() == n_entries;
+}
+
+static bool ValidIds(vector<uint32_t> const& ids, uint32_t n_symbols) {
+  for (uint32_t id : ids) {
+    if (id >= n_symbols) return false;
+  }
+  return true;
+}
+
+bool CompactGrammar::Valid() const {
+  size_t n_names = (size_t)n_non_terms_ + n_pos_tags_ + n_words_;
+  if (!ValidOffsets(name_offsets_, n_names, name_pool_.size())) return false;
+  if (root_ < -1 || root_ >= (int64_t)n_non_terms_) return false;
+  if (unknown_word_ < -1 || unknown_word_ >= (int64_t)n_words_) return false;
+  // Names must be unique per symbol type (the word index cannot even be
+  // built otherwise)
+  uint32_t index = 0;
+  for (uint32_t n_symbols : {n_non_terms_, n_pos_tags_, n_words_}) {
+    std::set<std::string_view> names;
+    for (uint32_t i = 0; i < n_symbols; i++, index++) {
+      std::string_view name(name_pool_.data() + name_offsets_[index],
+                            name_offsets_[index + 1] - name_offsets_[index]);
+      if (!names.insert(name).second) return false;
+    }
+  }
+
+  if (!ValidOffsets(lexicon_offsets_, n_words_, lexicon_pos_.size()) ||
+      !ValidOffsets(unary_offsets_, n_pos_tags_, unary_parent_.size()) ||
+      !ValidOffsets(left_offsets_, n_non_terms_, binary_parent_.size())) {
+    return false;
+  }
+  if (binary_left_.size() != binary_parent_.size() ||
+      binary_right_.size() != binary_parent_.size()) {
+    return false;
+  }
+  if (!ValidIds(lexicon_pos_, n_pos_tags_) ||
+      !ValidIds(unary_parent_, n_non_terms_) ||
+      !ValidIds(binary_parent_, n_non_terms_) ||
+      !ValidIds(binary_left_, n_non_terms_) ||
+      !ValidIds(binary_right_, n_non_terms_)) {
+    return false;
+  }
+  // Rules with left child B must be exactly those in B's range
+  for (uint32_t b = 0; b < n_non_terms_; b++) {
+    for (uint32_t r = left_offsets_[b]; r < left_offsets_[b + 1]; r++) {
+      if (binary_left_[r] != b) return false;
+    }
+  }
+
+  size_t n_rules =
+      lexicon_pos_.size() + unary_parent_.size() + binary_parent_.size();
+  if (precision_ == PRECISION_FLOAT) {
+    return log_probs_.size() == n_rules && log_prob_codes_.empty();
+  }
+  return log_prob_codes_.size() == n_rules && log_probs_.empty();
+}
+
+// Binary I/O helpers: a vector is written as its size followed by the data
+template <typename T>
+static void WriteValue(std::ofstream& out, T const& value) {
+  out.write((char const*)&value, sizeof(T));
+}
+
+template <typename T>
+static void WriteVector(std::ofstream& out, vector<T> const& v) {
+  WriteValue(out, (uint64_t)v.size());
+  out.write((char const*)v.data(), v.size() * sizeof(T));
+}
+
+template <typename T>
+static bool ReadValue(std::ifstream& in, T& value) {
+  return (bool)in.read((char*)&value, sizeof(T));
+}
+
+// Sizes larger than max_bytes (the file size) are rejected before any
+// allocation, so a corrupt size cannot exhaust memory
+template <typename T>
+static bool ReadVector(std::ifstream& in, vector<T>& v, uint64_t max_bytes) {
+  uint64_t size;
+  if (!ReadValue(in, size)) return false;
+  if (size > max_bytes / sizeof(T)) return false;
+  v.resize(size);
+  return (bool)in.read((char*)v.data(), size * sizeof(T));
+}
+
+bool CompactGrammar::Save(string const& path) const {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+  out.write(kMagic, sizeof(kMagic));
+  WriteValue(out, (int32_t)precision_);
+  WriteValue(out, root_);
+  WriteValue(out, unknown_word_);
+  WriteValue(out, n_non_terms_);
+  WriteValue(out, n_pos_tags_);
+  WriteValue(out, n_words_);
+  WriteValue(out, min_log_prob_);
+  WriteValue(out, log_prob_step_);
+  WriteVector(out, vector<char>(name_pool_.begin(), name_pool_.end()));
+  WriteVector(out, name_offsets_);
+  WriteVector(out, lexicon_offsets_);
+  WriteVector(out, lexicon_pos_);
+  WriteVector(out, unary_offsets_);
+  WriteVector(out, unary_parent_);
+  WriteVector(out, binary_parent_);
+  WriteVector(out, binary_left_);
+  WriteVector(out, binary_right_);
+  WriteVector(out, left_offsets_);
+  WriteVector(out, log_probs_);
+  WriteVector(out, log_prob_codes_);
+  return (bool)out;
+}
+
+bool CompactGrammar::Load(string const& path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  uint64_t file_bytes = in.tellg();
+  in.seekg(0);
+  char magic[sizeof(kMagic)];
+  if (!in.read(magic, sizeof(magic))) return false;
+  if (!std::equal(magic, magic + sizeof(magic), kMagic)) return false;
+
+  // Everything is read into a new grammar, this one is only replaced if
+  // the whole file is valid
+  CompactGrammar g;
+  int32_t precision;
+  vector<char> name_pool;
+  uint64_t max = file_bytes;
+  bool ok =
+      ReadValue(in, precision) && ReadValue(in, g.root_) &&
+      ReadValue(in, g.unknown_word_) && ReadValue(in, g.n_non_terms_) &&
+      ReadValue(in, g.n_pos_tags_) && ReadValue(in, g.n_words_) &&
+      ReadValue(in, g.min_log_prob_) && ReadValue(in, g.log_prob_step_) &&
+      ReadVector(in, name_pool, max) && ReadVector(in, g.name_offsets_, max) &&
+      ReadVector(in, g.lexicon_offsets_, max) &&
+      ReadVector(in, g.lexicon_pos_, max) &&
+      ReadVector(in, g.unary_offsets_, max) &&
+      ReadVector(in, g.unary_parent_, max) &&
+      ReadVector(in, g.binary_parent_, max) &&
+      ReadVector(in, g.binary_left_, max) &&
+      ReadVector(in, g.binary_right_, max) &&
+      ReadVector(in, g.left_offsets_, max) &&
+      ReadVector(in, g.log_probs_, max) &&
+      ReadVector(in, g.log_prob_codes_, max);
+  if (!ok || (precision != PRECISION_FLOAT && precision != PRECISION_16BIT)) {
+    return false;
+  }
+  g.precision_ = (LOG_PROB_PRECISION)precision;
+  g.name_pool_.assign(name_pool.begin(), name_pool.end());
+  if (!g.Valid()) return false;
+  *this = std::move(g);
+  return true;
+}
+
+// ---- Footprint estimates ----
+// Heap bytes owned by a value (not counting the value itself). Node sizes
+// follow libstdc++: red-black tree nodes carry 32 bytes of links and color.
+static const size_t kTreeNodeBytes = 32;
+
+static size_t HeapBytes(double) { return 0; }
+static size_t HeapBytes(int) { return 0; }
+static size_t HeapBytes(string const& s) {
+  // Short strings live inside the string object
+  return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+static size_t HeapBytes(Rule const& r);
+template <typename A, typename B>
+static size_t HeapBytes(pair<A, B> const& p);
+template <typename T>
+static size_t HeapBytes(vector<T> const& v);
+template <typename T>
+static size_t HeapBytes(set<T> const& s);
+template <typename K, typename V, typename C>
+static size_t HeapBytes(map<K, V, C> const& m);
+
+static size_t HeapBytes(Rule const& r) {
+  return HeapBytes(r.left_) + HeapBytes(r.right_);
+}
+
+template <typename A, typename B>
+static size_t HeapBytes(pair<A, B> const& p) {
+  return HeapBytes(p.first) + HeapBytes(p.second);
+}
+
+template <typename T>
+static size_t HeapBytes(vector<T> const& v) {
+  size_t bytes = v.capacity() * sizeof(T);
+  for (T const& e : v) bytes += HeapBytes(e);
+  return bytes;
+}
+
+template <typename T>
+static size_t HeapBytes(set<T> const& s) {
+  size_t bytes = 0;
+  for (T const& e : s) bytes += kTreeNodeBytes + sizeof(T) + HeapBytes(e);
+  return bytes;
+}
+
+template <typename K, typename V, typename C>
+static size_t HeapBytes(map<K, V, C> const& m) {
+  size_t bytes = 0;
+  for (auto const& e : m) {
+    bytes += kTreeNodeBytes + sizeof(e) + HeapBytes(e.first) +
+             HeapBytes(e.second);
+  }
+  return bytes;
+}
+
+size_t ApproximateMemoryBytes(PCFG const& pcfg) {
+  size_t bytes = sizeof(PCFG);
+  bytes += HeapBytes(pcfg.non_terminals_) + HeapBytes(pcfg.pos_tags_) +
+           HeapBytes(pcfg.lexicon_);
+  bytes += HeapBytes(pcfg.grammar_probs_) + HeapBytes(pcfg.lexicon_probs_);
+  bytes += pcfg.lexicon_hash_.MemoryBytes() +
+           HeapBytes(pcfg.lexicon_pos_tags_) +
+           HeapBytes(pcfg.reverse_grammar_single_) +
+           HeapBytes(pcfg.reverse_grammar_binary_);
+  bytes += HeapBytes(pcfg.non_term_ids_);
+  bytes += pcfg.left_children_.MemoryBytes() +
+           pcfg.right_children_.MemoryBytes();
+  for (SymbolSet const& s : pcfg.right_children_of_) {
+    bytes += sizeof(SymbolSet) + s.MemoryBytes();
+  }
+  return bytes;
+}
+
+size_t ApproximateMemoryBytes(IndexedGrammar const& g) {
+  size_t bytes = sizeof(IndexedGrammar);
+  bytes += HeapBytes(g.non_terms_) + HeapBytes(g.pos_tags_) +
+           HeapBytes(g.words_);
+  bytes += HeapBytes(g.non_term_ids_) + HeapBytes(g.pos_tag_ids_) +
+           HeapBytes(g.word_ids_);
+  bytes += g.word_hash_.MemoryBytes() + HeapBytes(g.word_of_slot_);
+  for (vector<int> const* v :
+       {&g.lexicon_offsets_, &g.lexicon_pos_, &g.unary_offsets_,
+        &g.unary_parent_, &g.binary_parent_, &g.binary_left_,
+        &g.binary_right_, &g.left_offsets_}) {
+    bytes += HeapBytes(*v);
+  }
+  for (vector<float> const* v :
+       {&g.lexicon_log_probs_, &g.unary_log_probs_, &g.binary_log_probs_}) {
+    bytes += v->capacity() * sizeof(float);
+  }
+  return bytes;
+}
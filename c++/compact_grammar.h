@@ -0,0 +1,99 @@
+#ifndef COMPACT_GRAMMAR_H
+#define COMPACT_GRAMMAR_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "indexed_grammar.h"
+#include "pcfg.h"
+
+using std::string;
+using std::vector;
+
+typedef enum {
+  PRECISION_FLOAT = 0,
+  PRECISION_16BIT = 1,
+} LOG_PROB_PRECISION;
+
+// Compact on-disk form of an IndexedGrammar, e.g. to ship a grammar
+// trained on a large treebank without the treebank or the PCFG maps.
+// - Symbol names are stored back to back in one character pool.
+// - Rules are packed into flat arrays of 32-bit ids.
+// - Log probabilities are either floats or quantized to 16 bits: a code c
+//   stands for min_log_prob_ + c * log_prob_step_ (uniform over
+//   [min_log_prob_, 0]).
+// This is a storage format only. Parsers run on the IndexedGrammar returned
+// by Expand(), which decodes the probabilities once; the CompactGrammar can
+// be dropped afterwards, so the 16-bit codes shrink the file, not the memory
+// of a running parser.
+class CompactGrammar {
+ public:
+  CompactGrammar()
+      : precision_(PRECISION_FLOAT),
+        root_(-1),
+        unknown_word_(-1),
+        n_non_terms_(0),
+        n_pos_tags_(0),
+        n_words_(0),
+        min_log_prob_(0),
+        log_prob_step_(1) {
+    name_offsets_.push_back(0);
+  }
+  CompactGrammar(IndexedGrammar const& grammar,
+                 LOG_PROB_PRECISION precision);
+
+  // Binary file format, all arrays in host byte order.
+  // Returns false if the file could not be written / read. Load also
+  // rejects files whose arrays are inconsistent and leaves this grammar
+  // unchanged on failure.
+  bool Save(string const& path) const;
+  bool Load(string const& path);
+
+  IndexedGrammar Expand() const;
+
+  LOG_PROB_PRECISION precision() const { return precision_; }
+
+ private:
+  LOG_PROB_PRECISION precision_;
+  int32_t root_;
+  int32_t unknown_word_;
+
+  // Names of the NonTerms, then POS-tags, then words
+  string name_pool_;
+  vector<uint32_t> name_offsets_;
+  uint32_t n_non_terms_;
+  uint32_t n_pos_tags_;
+  uint32_t n_words_;
+
+  vector<uint32_t> lexicon_offsets_;
+  vector<uint32_t> lexicon_pos_;
+  vector<uint32_t> unary_offsets_;
+  vector<uint32_t> unary_parent_;
+  vector<uint32_t> binary_parent_;
+  vector<uint32_t> binary_left_;
+  vector<uint32_t> binary_right_;
+  vector<uint32_t> left_offsets_;
+
+  // Log probabilities of all lexicon, then unary, then binary rules.
+  // Only one of the two vectors is used, depending on precision_.
+  vector<float> log_probs_;
+  vector<uint16_t> log_prob_codes_;
+  float min_log_prob_;
+  float log_prob_step_;
+
+  string Name(uint32_t index) const;
+  void AppendLogProbs(vector<float> const& log_probs);
+  float LogProb(size_t index) const;
+  // Tests whether all ids and offsets are in range, i.e. whether Expand()
+  // is safe and yields a usable IndexedGrammar
+  bool Valid() const;
+};
+
+// Rough heap footprint of the data structures (including the nodes of
+// maps and sets and the characters of strings), for comparisons
+size_t ApproximateMemoryBytes(PCFG const& pcfg);
+size_t ApproximateMemoryBytes(IndexedGrammar const& grammar);
+
+#endif
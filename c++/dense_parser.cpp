@@ -0,0 +1,651 @@
+#include "dense_parser.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <memory>
+
+static const float kLogZero = -std::numeric_limits<float>::infinity();
+
+// best[r] = max(best[r], (log_probs[r] + left_score) + right_cell[right[r]])
+// for r in [begin, end)
+static void MaxPlusScalar(float* best, float const* log_probs,
+                          int const* right, float const* right_cell,
+                          float left_score, int begin, int end) {
+  for (int r = begin; r < end; r++) {
+    float score = (log_probs[r] + left_score) + right_cell[right[r]];
+    best[r] = std::max(best[r], score);
+  }
+}
+
+__attribute__((target("avx2")))
+static void MaxPlusAvx2(float* best, float const* log_probs,
+                        int const* right, float const* right_cell,
+                        float left_score, int begin, int end) {
+  __m256 left = _mm256_set1_ps(left_score);
+  int r = begin;
+  for (; r + 8 <= end; r += 8) {
+    __m256i index = _mm256_loadu_si256((__m256i const*)(right + r));
+    __m256 right_scores = _mm256_i32gather_ps(right_cell, index, 4);
+    __m256 score = _mm256_add_ps(
+        _mm256_add_ps(_mm256_loadu_ps(log_probs + r), left), right_scores);
+    _mm256_storeu_ps(best + r, _mm256_max_ps(_mm256_loadu_ps(best + r), score));
+  }
+  MaxPlusScalar(best, log_probs, right, right_cell, left_score, r, end);
+}
+
+// The tail is handled with masked loads and stores instead of the scalar
+// kernel. The gather and the max take explicit sources for masked-off lanes
+// (kLogZero and the current best), so no lane is ever undefined.
+__attribute__((target("avx512f")))
+static void MaxPlusAvx512(float* best, float const* log_probs,
+                          int const* right, float const* right_cell,
+                          float left_score, int begin, int end) {
+  __m512 left = _mm512_set1_ps(left_score);
+  __m512 zero = _mm512_set1_ps(kLogZero);
+  for (int r = begin; r < end; r += 16) {
+    __mmask16 mask = end - r >= 16 ? 0xFFFF : (1 << (end - r)) - 1;
+    __m512i index = _mm512_maskz_loadu_epi32(mask, right + r);
+    __m512 right_scores =
+        _mm512_mask_i32gather_ps(zero, mask, index, right_cell, 4);
+    __m512 score = _mm512_add_ps(
+        _mm512_add_ps(_mm512_maskz_loadu_ps(mask, log_probs + r), left),
+        right_scores);
+    __m512 current = _mm512_maskz_loadu_ps(mask, best + r);
+    _mm512_mask_storeu_ps(best + r, mask,
+                          _mm512_mask_max_ps(current, mask, current, score));
+  }
+}
+
+DenseParser::DenseParser(IndexedGrammar const& grammar, KERNEL_TYPE kernel)
+    : grammar_(grammar),
+      cache_(nullptr),
+      tagger_(nullptr),
+      tag_margin_(0),
+      pruned_tags_(0),
+      tag_fallback_(false),
+      max_seconds_(0),
+      max_edges_(0),
+      edges_(0),
+      partial_(false),
+      chart_complete_(false),
+      n_(0),
+      n_non_terms_(grammar.num_non_terms()),
+      n_pos_tags_(grammar.num_pos_tags()) {
+  if (kernel == KERNEL_AUTO) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      kernel = KERNEL_AVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+      kernel = KERNEL_AVX2;
+    } else {
+      kernel = KERNEL_SCALAR;
+    }
+  }
+  kernel_ = kernel;
+  if (kernel == KERNEL_AVX512) {
+    max_plus_ = MaxPlusAvx512;
+  } else if (kernel == KERNEL_AVX2) {
+    max_plus_ = MaxPlusAvx2;
+  } else {
+    max_plus_ = MaxPlusScalar;
+  }
+
+  for (int b = 0; b < n_non_terms_; b++) {
+    if (grammar.left_offsets_[b] < grammar.left_offsets_[b + 1]) {
+      left_symbols_.push_back(b);
+    }
+  }
+
+  // Binary rules by parent (counting sort, keeps the rule order)
+  parent_offsets_.assign(n_non_terms_ + 1, 0);
+  for (int r = 0; r < grammar.num_binary_rules(); r++) {
+    parent_offsets_[grammar.binary_parent_[r] + 1]++;
+  }
+  for (int a = 0; a < n_non_terms_; a++) {
+    parent_offsets_[a + 1] += parent_offsets_[a];
+  }
+  parent_rules_.resize(grammar.num_binary_rules());
+  vector<int> next(parent_offsets_.begin(), parent_offsets_.end() - 1);
+  for (int r = 0; r < grammar.num_binary_rules(); r++) {
+    parent_rules_[next[grammar.binary_parent_[r]]++] = r;
+  }
+
+  unary_pos_.resize(grammar.num_unary_rules());
+  for (int t = 0; t < n_pos_tags_; t++) {
+    for (int j = grammar.unary_offsets_[t]; j < grammar.unary_offsets_[t + 1];
+         j++) {
+      unary_pos_[j] = t;
+    }
+  }
+  rule_best_.assign(grammar.num_binary_rules(), kLogZero);
+  touched_.resize(left_symbols_.size());
+}
+
+void DenseParser::Reset(vector<string_view> const& tokens) {
+  SetTokens(tokens);
+  ResetChart(tokens.size());
+}
+
+void DenseParser::SetTokens(vector<string_view> const& tokens) {
+  tokens_ = tokens;
+  word_ids_.clear();
+  candidate_offsets_.clear();
+  for (size_t i = 0; i < tokens.size(); i++) {
+    candidate_offsets_.push_back(i);
+    word_ids_.push_back(grammar_.WordId(tokens[i]));
+  }
+  candidate_offsets_.push_back(tokens.size());
+  candidate_weights_.assign(tokens.size(), 0);
+}
+
+void DenseParser::Reset(vector<vector<pair<string, double> > > const& lattice) {
+  tokens_.clear();
+  word_ids_.clear();
+  candidate_offsets_.clear();
+  candidate_weights_.clear();
+  for (vector<pair<string, double> > const& candidates : lattice) {
+    candidate_offsets_.push_back(tokens_.size());
+    for (pair<string, double> const& candidate : candidates) {
+      tokens_.push_back(candidate.first);
+      word_ids_.push_back(grammar_.WordId(candidate.first));
+      candidate_weights_.push_back(candidate.second);
+    }
+  }
+  candidate_offsets_.push_back(tokens_.size());
+  ResetChart(lattice.size());
+}
+
+void DenseParser::ResetChart(int n) {
+  n_ = n;
+  row_offsets_.assign(n_ + 2, 0);
+  for (int length = 1; length <= n_; length++) {
+    row_offsets_[length + 1] = row_offsets_[length] + n_ - length + 1;
+  }
+  int n_cells = row_offsets_[n_ + 1];
+  cell_slots_.resize(n_cells);
+  for (int cell = 0; cell < n_cells; cell++) {
+    cell_slots_[cell] = cell;
+  }
+  chart_.assign((size_t)n_cells * n_non_terms_, kLogZero);
+  pos_chart_.assign((size_t)n_ * n_pos_tags_, kLogZero);
+}
+
+// POS-tag -> token (the best over the candidates)
+void DenseParser::FillPosScores(int i) {
+  IndexedGrammar const& g = grammar_;
+  float* pos = PosScores(i);
+  for (int c = candidate_offsets_[i]; c < candidate_offsets_[i + 1]; c++) {
+    int w = word_ids_[c];
+    if (w < 0) continue;
+    for (int e = g.lexicon_offsets_[w]; e < g.lexicon_offsets_[w + 1]; e++) {
+      int t = g.lexicon_pos_[e];
+      pos[t] = std::max(pos[t], g.lexicon_log_probs_[e] + candidate_weights_[c]);
+    }
+  }
+}
+
+// NonTerm -> POS-tag
+void DenseParser::FillWordCell(int i) {
+  IndexedGrammar const& g = grammar_;
+  float const* pos = PosScores(i);
+  float* scores = Scores(Cell(i, 1));
+  for (int t = 0; t < n_pos_tags_; t++) {
+    if (pos[t] == kLogZero) continue;
+    for (int j = g.unary_offsets_[t]; j < g.unary_offsets_[t + 1]; j++) {
+      float score = g.unary_log_probs_[j] + pos[t];
+      int a = g.unary_parent_[j];
+      scores[a] = std::max(scores[a], score);
+    }
+  }
+}
+
+// Spelling of the candidate at position i that gave POS-tag t its score
+string_view DenseParser::Leaf(int i, int t) {
+  IndexedGrammar const& g = grammar_;
+  float const* pos = PosScores(i);
+  for (int c = candidate_offsets_[i]; c < candidate_offsets_[i + 1]; c++) {
+    int w = word_ids_[c];
+    if (w < 0) continue;
+    for (int e = g.lexicon_offsets_[w]; e < g.lexicon_offsets_[w + 1]; e++) {
+      if (g.lexicon_pos_[e] == t &&
+          g.lexicon_log_probs_[e] + candidate_weights_[c] == pos[t]) {
+        return tokens_[c];
+      }
+    }
+  }
+  return tokens_[candidate_offsets_[i]];
+}
+
+void DenseParser::FillCell(int start, int length) {
+  edges_ += FillCell(start, length, *this);
+}
+
+long DenseParser::FillCell(int start, int length, DenseParser& worker) {
+  IndexedGrammar const& g = grammar_;
+  vector<float>& rule_best = worker.rule_best_;
+  vector<bool>& touched = worker.touched_;
+  long edges = 0;
+  std::fill(touched.begin(), touched.end(), false);
+  for (int left_length = 1; left_length < length; left_length++) {
+    float const* left = Scores(Cell(start, left_length));
+    float const* right = Scores(Cell(start + left_length, length - left_length));
+    for (size_t i = 0; i < left_symbols_.size(); i++) {
+      int b = left_symbols_[i];
+      if (left[b] == kLogZero) continue;
+      max_plus_(rule_best.data(), g.binary_log_probs_.data(),
+                g.binary_right_.data(), right, left[b], g.left_offsets_[b],
+                g.left_offsets_[b + 1]);
+      edges += g.left_offsets_[b + 1] - g.left_offsets_[b];
+      touched[i] = true;
+    }
+  }
+
+  // Only rule groups that were touched can hold a score. They are reset
+  // right away, so rule_best_ is all -inf again for the next cell.
+  float* scores = Scores(Cell(start, length));
+  for (size_t i = 0; i < left_symbols_.size(); i++) {
+    if (!touched[i]) continue;
+    int b = left_symbols_[i];
+    for (int r = g.left_offsets_[b]; r < g.left_offsets_[b + 1]; r++) {
+      int a = g.binary_parent_[r];
+      scores[a] = std::max(scores[a], rule_best[r]);
+      rule_best[r] = kLogZero;
+    }
+  }
+  return edges;
+}
+
+void DenseParser::FillCellCached(int start, int length) {
+  SpanScores cached;
+  bool admit;
+  float* scores = Scores(Cell(start, length));
+  if (cache_->GetSpan(&word_ids_[start], length, cached, admit)) {
+    for (pair<int, float> const& score : *cached) {
+      scores[score.first] = score.second;
+    }
+    return;
+  }
+  FillCell(start, length);
+  if (!admit) return;
+  auto finite = std::make_shared<vector<pair<int, float> > >();
+  for (int a = 0; a < n_non_terms_; a++) {
+    if (scores[a] != kLogZero) finite->push_back(std::make_pair(a, scores[a]));
+  }
+  cache_->PutSpan(&word_ids_[start], length, finite);
+}
+
+/**
+ * Finds the rule application that produced the score of symbol in the
+ * span, by redoing the float operations of the kernels in the same order.
+ */
+shared_ptr<Tree<string> > DenseParser::BuildTree(int start, int length,
+                                                 int symbol) {
+  IndexedGrammar const& g = grammar_;
+  float target = Scores(Cell(start, length))[symbol];
+  auto tree = make_shared<Tree<string> >(g.non_terms_[symbol]);
+
+  if (length == 1) {
+    float const* pos = PosScores(start);
+    for (int j = 0; j < g.num_unary_rules(); j++) {
+      int t = unary_pos_[j];
+      if (g.unary_parent_[j] != symbol || pos[t] == kLogZero) continue;
+      if (g.unary_log_probs_[j] + pos[t] != target) continue;
+      shared_ptr<Tree<string> > pos_tree = tree->MakeChild(g.pos_tags_[t]);
+      // Unknown words keep their spelling in the tree
+      pos_tree->MakeChild(string(Leaf(start, t)));
+      return tree;
+    }
+    return tree;
+  }
+
+  for (int i = parent_offsets_[symbol]; i < parent_offsets_[symbol + 1]; i++) {
+    int r = parent_rules_[i];
+    int b = g.binary_left_[r];
+    int c = g.binary_right_[r];
+    for (int left_length = 1; left_length < length; left_length++) {
+      float left = Scores(Cell(start, left_length))[b];
+      float right = Scores(Cell(start + left_length, length - left_length))[c];
+      if (left == kLogZero || right == kLogZero) continue;
+      if ((g.binary_log_probs_[r] + left) + right != target) continue;
+      shared_ptr<Tree<string> > left_tree = BuildTree(start, left_length, b);
+      shared_ptr<Tree<string> > right_tree =
+          BuildTree(start + left_length, length - left_length, c);
+      left_tree->parent_ = tree->weak_from_this();
+      right_tree->parent_ = tree->weak_from_this();
+      tree->AddChild(left_tree);
+      tree->AddChild(right_tree);
+      return tree;
+    }
+  }
+  return tree;
+}
+
+pTreeProb DenseParser::Parse(vector<string> const& tokens) {
+  return Parse(vector<string_view>(tokens.begin(), tokens.end()));
+}
+
+/**
+ * Covers the tokens with completed constituents (the best symbol of a
+ * non empty cell each) such that the sum of their log probabilities is
+ * maximal, and puts them under one SENT node.
+ */
+pTreeProb DenseParser::BuildCover() {
+  // best[j]: best cover of tokens [0, j), made of the cells
+  // (cover_start[j], j - cover_start[j]) and the cover of the rest
+  vector<float> best(n_ + 1, kLogZero);
+  vector<int> cover_start(n_ + 1, -1);
+  vector<int> cover_symbol(n_ + 1, -1);
+  best[0] = 0;
+  for (int end = 1; end <= n_; end++) {
+    for (int start = 0; start < end; start++) {
+      if (best[start] == kLogZero) continue;
+      float const* scores = Scores(Cell(start, end - start));
+      int symbol = std::max_element(scores, scores + n_non_terms_) - scores;
+      if (scores[symbol] == kLogZero) continue;
+      if (best[start] + scores[symbol] > best[end]) {
+        best[end] = best[start] + scores[symbol];
+        cover_start[end] = start;
+        cover_symbol[end] = symbol;
+      }
+    }
+  }
+  pTreeProb result(nullptr, kLogZero);
+  if (best[n_] == kLogZero) return result;
+
+  string root = grammar_.root_ >= 0 ? grammar_.non_terms_[grammar_.root_]
+                                    : string("SENT");
+  result.first = make_shared<Tree<string> >(root);
+  result.second = best[n_];
+  vector<shared_ptr<Tree<string> > > pieces;
+  for (int end = n_; end > 0; end = cover_start[end]) {
+    pieces.push_back(
+        BuildTree(cover_start[end], end - cover_start[end], cover_symbol[end]));
+  }
+  for (int i = pieces.size() - 1; i >= 0; i--) {
+    pieces[i]->parent_ = result.first->weak_from_this();
+    result.first->AddChild(pieces[i]);
+  }
+  return result;
+}
+
+pTreeProb DenseParser::Parse(vector<string_view> const& tokens) {
+  pTreeProb result(nullptr, kLogZero);
+  partial_ = false;
+  edges_ = 0;
+  if (tokens.empty()) return result;
+  if (cache_ != nullptr && cache_->GetSentence(tokens, result)) {
+    // The chart belongs to another sentence now
+    chart_complete_ = false;
+    return result;
+  }
+  Reset(tokens);
+  result = ParseChart(cache_ != nullptr ? cache_->max_span_length() : 0);
+  // Partial results are not cached, they may depend on the budget
+  if (cache_ != nullptr && !partial_) cache_->PutSentence(tokens, result);
+  return result;
+}
+
+pTreeProb DenseParser::Parse(
+    vector<vector<pair<string, double> > > const& lattice) {
+  partial_ = false;
+  edges_ = 0;
+  if (lattice.empty()) return pTreeProb(nullptr, kLogZero);
+  Reset(lattice);
+  // Span keys are word ids, which do not describe a lattice position
+  pTreeProb result = ParseChart(0);
+  // Reparse works on plain tokens only
+  chart_complete_ = false;
+  return result;
+}
+
+void DenseParser::UseTagger(TrigramTagger const* tagger, double margin) {
+  tagger_ = tagger;
+  tag_margin_ = margin;
+  tagger_tags_.assign(n_pos_tags_, -1);
+  if (tagger == nullptr) return;
+  map<string, int> tag_ids;
+  for (int k = 0; k < tagger->num_tags(); k++) tag_ids[tagger->tags()[k]] = k;
+  for (int t = 0; t < n_pos_tags_; t++) {
+    auto it = tag_ids.find(grammar_.pos_tags_[t]);
+    if (it != tag_ids.end()) tagger_tags_[t] = it->second;
+  }
+}
+
+void DenseParser::PruneTags() {
+  int n_tags = tagger_->num_tags();
+  tag_emissions_.assign((size_t)n_ * n_tags, kLogZero);
+  for (int i = 0; i < n_; i++) {
+    float const* pos = PosScores(i);
+    for (int t = 0; t < n_pos_tags_; t++) {
+      if (tagger_tags_[t] < 0) continue;
+      tag_emissions_[(size_t)i * n_tags + tagger_tags_[t]] = pos[t];
+    }
+  }
+  tagger_->Posteriors(tag_emissions_.data(), n_, tag_posteriors_);
+  for (int i = 0; i < n_; i++) {
+    double const* posteriors = &tag_posteriors_[(size_t)i * n_tags];
+    double best = *std::max_element(posteriors, posteriors + n_tags);
+    // The tagger found no tag sequence, keep everything
+    if (best == 0) continue;
+    float* pos = PosScores(i);
+    for (int t = 0; t < n_pos_tags_; t++) {
+      if (pos[t] == kLogZero || tagger_tags_[t] < 0) continue;
+      if (posteriors[tagger_tags_[t]] < tag_margin_ * best) {
+        pos[t] = kLogZero;
+        pruned_tags_++;
+      }
+    }
+  }
+}
+
+pTreeProb DenseParser::ParseChart(int max_cached_length) {
+  auto start_time = std::chrono::steady_clock::now();
+  pruned_tags_ = 0;
+  tag_fallback_ = false;
+  for (int i = 0; i < n_; i++) {
+    FillPosScores(i);
+  }
+  if (tagger_ != nullptr) {
+    PruneTags();
+    max_cached_length = 0;
+  }
+  pTreeProb result = FillChart(max_cached_length, start_time);
+  if (pruned_tags_ > 0 && partial_ && chart_complete_) {
+    // No analysis with the narrowed tags, again with all of them
+    result = RetryWithAllTags(max_cached_length, start_time);
+  }
+  return result;
+}
+
+pTreeProb DenseParser::RetryWithAllTags(
+    int max_cached_length, std::chrono::steady_clock::time_point start_time) {
+  tag_fallback_ = true;
+  partial_ = false;
+  ResetChart(n_);
+  for (int i = 0; i < n_; i++) {
+    FillPosScores(i);
+  }
+  return FillChart(max_cached_length, start_time);
+}
+
+void DenseParser::StartChart(vector<string_view> const& tokens) {
+  chart_start_time_ = std::chrono::steady_clock::now();
+  partial_ = false;
+  edges_ = 0;
+  pruned_tags_ = 0;
+  tag_fallback_ = false;
+  Reset(tokens);
+  for (int i = 0; i < n_; i++) {
+    FillPosScores(i);
+  }
+  if (tagger_ != nullptr) PruneTags();
+  for (int i = 0; i < n_; i++) {
+    FillWordCell(i);
+  }
+}
+
+long DenseParser::FillRow(int length, int begin, int end,
+                          DenseParser& worker) {
+  long edges = 0;
+  for (int start = begin; start < end; start++) {
+    edges += FillCell(start, length, worker);
+  }
+  return edges;
+}
+
+pTreeProb DenseParser::FinishChart(bool stopped) {
+  pTreeProb result(nullptr, kLogZero);
+  if (n_ == 0) return result;
+  result = FinishParse(stopped);
+  if (pruned_tags_ > 0 && partial_ && chart_complete_) {
+    result = RetryWithAllTags(0, chart_start_time_);
+  }
+  return result;
+}
+
+pTreeProb DenseParser::FillChart(
+    int max_cached_length, std::chrono::steady_clock::time_point start_time) {
+  for (int i = 0; i < n_; i++) {
+    FillWordCell(i);
+  }
+  bool stopped = false;
+  for (int length = 2; length <= n_ && !stopped; length++) {
+    for (int start = 0; start + length <= n_; start++) {
+      if (OverBudget(start_time)) {
+        stopped = true;
+        break;
+      }
+      // The whole sentence is cached as a tree instead
+      if (length <= max_cached_length && length < n_) {
+        FillCellCached(start, length);
+      } else {
+        FillCell(start, length);
+      }
+    }
+  }
+  return FinishParse(stopped);
+}
+
+pTreeProb DenseParser::FinishParse(bool stopped) {
+  pTreeProb result(nullptr, kLogZero);
+  chart_complete_ = !stopped;
+  float const* top = Scores(Cell(0, n_));
+  int root = grammar_.root_;
+  if (root < 0 || top[root] == kLogZero) {
+    root = std::max_element(top, top + n_non_terms_) - top;
+  }
+  if (!stopped && top[root] != kLogZero) {
+    result.first = BuildTree(0, n_, root);
+    result.second = top[root];
+  } else {
+    result = BuildCover();
+    partial_ = true;
+  }
+  return result;
+}
+
+pTreeProb DenseParser::Reparse(vector<string_view> const& tokens, int position,
+                               int n_removed, int n_inserted) {
+  int old_n = n_;
+  if (!chart_complete_ || tagger_ != nullptr || tokens.empty() ||
+      (int)tokens.size() != old_n - n_removed + n_inserted) {
+    ParseCache* cache = cache_;
+    cache_ = nullptr;
+    pTreeProb result = Parse(tokens);
+    cache_ = cache;
+    return result;
+  }
+  partial_ = false;
+  edges_ = 0;
+  auto start_time = std::chrono::steady_clock::now();
+  SetTokens(tokens);
+  n_ = tokens.size();
+  int shift = n_inserted - n_removed;
+
+  // Old position / span start of a new one that is not affected by the
+  // edit, -1 for affected ones
+  auto old_start = [&](int start, int length) {
+    if (start + length <= position) return start;
+    if (start >= position + n_inserted) return start - shift;
+    return -1;
+  };
+
+  vector<float> old_pos_chart;
+  old_pos_chart.swap(pos_chart_);
+  pos_chart_.assign((size_t)n_ * n_pos_tags_, kLogZero);
+  for (int i = 0; i < n_; i++) {
+    int old_i = old_start(i, 1);
+    if (old_i < 0) continue;
+    std::copy_n(&old_pos_chart[(size_t)old_i * n_pos_tags_], n_pos_tags_,
+                PosScores(i));
+  }
+
+  // Unaffected cells keep their slot in chart_; the slots of dropped
+  // cells are reused for the affected ones
+  vector<int> old_row_offsets;
+  vector<int> old_slots;
+  old_row_offsets.swap(row_offsets_);
+  old_slots.swap(cell_slots_);
+  row_offsets_.assign(n_ + 2, 0);
+  for (int length = 1; length <= n_; length++) {
+    row_offsets_[length + 1] = row_offsets_[length] + n_ - length + 1;
+  }
+  int n_slots = chart_.size() / n_non_terms_;
+  vector<bool> slot_used(n_slots, false);
+  vector<bool> affected(row_offsets_[n_ + 1], false);
+  cell_slots_.assign(row_offsets_[n_ + 1], -1);
+  for (int length = 1; length <= n_; length++) {
+    for (int start = 0; start + length <= n_; start++) {
+      int old = old_start(start, length);
+      if (old < 0) {
+        affected[Cell(start, length)] = true;
+        continue;
+      }
+      int slot = old_slots[old_row_offsets[length] + old];
+      cell_slots_[Cell(start, length)] = slot;
+      slot_used[slot] = true;
+    }
+  }
+  int free_slot = 0;
+  for (int cell = 0; cell < row_offsets_[n_ + 1]; cell++) {
+    if (!affected[cell]) continue;
+    while (free_slot < n_slots && slot_used[free_slot]) free_slot++;
+    if (free_slot < n_slots) {
+      cell_slots_[cell] = free_slot++;
+    } else {
+      cell_slots_[cell] = chart_.size() / n_non_terms_;
+      chart_.resize(chart_.size() + n_non_terms_);
+    }
+    std::fill_n(Scores(cell), n_non_terms_, kLogZero);
+  }
+
+  for (int i = position; i < position + n_inserted; i++) {
+    FillPosScores(i);
+    FillWordCell(i);
+  }
+  bool stopped = false;
+  for (int length = 2; length <= n_ && !stopped; length++) {
+    for (int start = 0; start + length <= n_; start++) {
+      if (!affected[Cell(start, length)]) continue;
+      if (OverBudget(start_time)) {
+        stopped = true;
+        break;
+      }
+      FillCell(start, length);
+    }
+  }
+  return FinishParse(stopped);
+}
+
+bool DenseParser::OverBudget(
+    std::chrono::steady_clock::time_point start_time) const {
+  if (max_edges_ > 0 && edges_ >= max_edges_) return true;
+  if (max_seconds_ <= 0) return false;
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  return elapsed.count() >= max_seconds_;
+}
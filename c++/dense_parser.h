@@ -0,0 +1,210 @@
+#ifndef DENSE_PARSER_H
+#define DENSE_PARSER_H
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "indexed_grammar.h"
+#include "parse_cache.h"
+#include "pos_tagger.h"
+#include "tree.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+typedef enum {
+  KERNEL_AUTO = 0,
+  KERNEL_SCALAR = 1,
+  KERNEL_AVX2 = 2,
+  KERNEL_AVX512 = 3,
+} KERNEL_TYPE;
+
+// Probabilistic CYK on a dense chart.
+// Every span holds one contiguous float array of log probabilities indexed
+// by NonTerm id (-inf if the symbol cannot generate the span), instead of
+// a vector of tree pointers. Combining two cells is a max-plus product over
+// the binary rules, which are stored as structure of arrays sorted by
+// (left, right) in the IndexedGrammar:
+//   best[r] = max(best[r], log p(r) + left[B(r)] + right[C(r)])
+// This runs over whole rule groups at once with AVX2 or AVX-512 gathers.
+// The scalar kernel does exactly the same float operations, so all kernels
+// produce bit identical charts and therefore identical trees.
+//
+// Only scores are kept in the chart. The tree is recovered afterwards by
+// searching, for each node on the best path, the rule and split that
+// reproduce its score.
+//
+// An instance keeps its buffers between sentences and must not be shared
+// between threads.
+class DenseParser {
+ public:
+  DenseParser(IndexedGrammar const& grammar, KERNEL_TYPE kernel = KERNEL_AUTO);
+
+  // Computes the Maximum Likelihood Constituency Tree for the tokens.
+  // The root is the start symbol SENT if possible, otherwise the most
+  // likely symbol of the top cell (like PCFG::GetMostLikely).
+  // If the top cell is empty or the budget runs out, the result is the
+  // highest scoring cover of the tokens by completed constituents, under a
+  // SENT root, and partial() is true. Its log probability is the sum of
+  // those of the constituents.
+  // Returns the tree (nullptr if there is none) and its log probability.
+  pTreeProb Parse(vector<string> const& tokens);
+  // Same, for tokens that are views into a text buffer (see Tokenizer).
+  // The buffer must stay valid during the call only.
+  pTreeProb Parse(vector<string_view> const& tokens);
+  // Same, for a word lattice: every position has candidate words with a
+  // log weight (e.g. spelling corrections), and the best candidate is
+  // chosen as part of the parse. Leaves carry the chosen spelling.
+  // The cache is not used for lattices.
+  pTreeProb Parse(vector<vector<pair<string, double> > > const& lattice);
+
+  KERNEL_TYPE kernel() { return kernel_; }
+
+  // Parses tokens, which differ from the tokens of the previous parse by
+  // an edit: n_removed tokens at position were replaced by n_inserted
+  // ones. Only the spans that contain the edit are recomputed, the others
+  // are taken over (shifted) from the previous chart. Falls back to Parse
+  // if the previous chart is not complete. See ParseSession.
+  pTreeProb Reparse(vector<string_view> const& tokens, int position,
+                    int n_removed, int n_inserted);
+
+  // Limits the work per sentence: the chart is filled until max_seconds
+  // have passed or max_edges rule applications were tried (0 = no limit).
+  // The check happens between cells, so a budget can be exceeded by at
+  // most one cell.
+  void SetBudget(double max_seconds, long max_edges) {
+    max_seconds_ = max_seconds;
+    max_edges_ = max_edges;
+  }
+  // Whether the last Parse returned a partial analysis
+  bool partial() const { return partial_; }
+  // Rule applications tried by the last Parse
+  long edges() const { return edges_; }
+
+  // Looks up and stores sentences (and spans, if enabled) in cache.
+  // The cache may be shared with other parsers on the same grammar;
+  // nullptr disables caching.
+  void UseCache(ParseCache* cache) { cache_ = cache; }
+
+  // Parsing a sentence in steps, so that the cells of one chart row can be
+  // filled by several threads at once (see BatchParser):
+  // - StartChart sets up the chart of tokens and fills the word row
+  //   (including the tagger pre-pass),
+  // - FillRow fills the cells (start, length) for start in [begin, end)
+  //   with the scratch buffers of worker, any parser on the same grammar
+  //   that is not used by another thread meanwhile (e.g. the calling
+  //   thread's own one). Returns the number of rule applications. Cells of
+  //   a row can be filled concurrently once all shorter rows are complete.
+  // - FinishChart builds the result from the filled rows, stopped tells
+  //   that the budget ran out before all rows were filled.
+  // The span cache and the edge budget are not used on this path.
+  void StartChart(vector<string_view> const& tokens);
+  long FillRow(int length, int begin, int end, DenseParser& worker);
+  pTreeProb FinishChart(bool stopped);
+  // Whether the time budget of the sentence begun by StartChart is used up
+  bool ChartOverBudget() const { return OverBudget(chart_start_time_); }
+  int num_tokens() const { return n_; }
+
+  // Narrows the POS-tags of every token before the chart is filled: a tag
+  // is kept if its posterior under tagger (given the POS-tag scores of the
+  // whole sentence) is at least margin times that of the best tag of the
+  // token. If the narrowed chart has no analysis, the sentence is parsed
+  // again with all tags. nullptr disables the pre-pass.
+  // tagger must outlive the parser. While it is set, the span cache is not
+  // used (spans would depend on their context) and Reparse parses the
+  // whole sentence.
+  void UseTagger(TrigramTagger const* tagger, double margin);
+  // (token, POS-tag) pairs the tagger removed in the last Parse
+  int pruned_tags() const { return pruned_tags_; }
+  // Whether the last Parse had to fall back to all tags
+  bool tag_fallback() const { return tag_fallback_; }
+
+ private:
+  typedef void (*MaxPlusKernel)(float* best, float const* log_probs,
+                                int const* right, float const* right_cell,
+                                float left_score, int begin, int end);
+
+  IndexedGrammar const& grammar_;
+  KERNEL_TYPE kernel_;
+  MaxPlusKernel max_plus_;
+  ParseCache* cache_;
+  TrigramTagger const* tagger_;
+  double tag_margin_;
+  // POS-tag id --> tag id of tagger_ (-1 if the tagger does not know it)
+  vector<int> tagger_tags_;
+  vector<float> tag_emissions_;
+  vector<double> tag_posteriors_;
+  int pruned_tags_;
+  bool tag_fallback_;
+  double max_seconds_;
+  long max_edges_;
+  long edges_;
+  bool partial_;
+  // Whether the chart holds all cells of the tokens (for Reparse)
+  bool chart_complete_;
+  int n_;
+  std::chrono::steady_clock::time_point chart_start_time_;
+  int n_non_terms_;
+  int n_pos_tags_;
+
+  // NonTerms that are the left child of at least one binary rule
+  vector<int> left_symbols_;
+  // Binary and unary rules by parent, to recover the tree
+  vector<int> parent_offsets_;
+  vector<int> parent_rules_;
+  vector<int> unary_pos_;
+
+  // Candidate words per position: position i has the candidates
+  // [candidate_offsets_[i], candidate_offsets_[i + 1]). A plain sentence
+  // has one candidate of weight 0 per token.
+  vector<int> candidate_offsets_;
+  vector<string_view> tokens_;
+  vector<int> word_ids_;
+  vector<float> candidate_weights_;
+  vector<int> row_offsets_;
+  // The scores of cell c are at chart_[cell_slots_[c] * n_non_terms_], so
+  // Reparse can move cells without copying them
+  vector<int> cell_slots_;
+  vector<float> chart_;
+  vector<float> pos_chart_;
+  // One entry per binary rule, reused for every cell
+  vector<float> rule_best_;
+  // Whether the rules of left_symbols_[i] were combined in the current cell
+  vector<bool> touched_;
+
+  int Cell(int start, int length) { return row_offsets_[length] + start; }
+  float* Scores(int cell) {
+    return &chart_[(size_t)cell_slots_[cell] * n_non_terms_];
+  }
+  float* PosScores(int i) { return &pos_chart_[(size_t)i * n_pos_tags_]; }
+  void Reset(vector<string_view> const& tokens);
+  void Reset(vector<vector<pair<string, double> > > const& lattice);
+  void SetTokens(vector<string_view> const& tokens);
+  void ResetChart(int n);
+  pTreeProb ParseChart(int max_cached_length);
+  // Fills the chart above the POS-tag row
+  pTreeProb FillChart(int max_cached_length,
+                      std::chrono::steady_clock::time_point start_time);
+  void PruneTags();
+  pTreeProb FinishParse(bool stopped);
+  void FillPosScores(int i);
+  void FillWordCell(int i);
+  string_view Leaf(int i, int t);
+  void FillCell(int start, int length);
+  // FillCell with the scratch buffers (rule_best_, touched_) of worker,
+  // returns the number of rule applications
+  long FillCell(int start, int length, DenseParser& worker);
+  // Parses again without the tagger pre-pass (see UseTagger)
+  pTreeProb RetryWithAllTags(int max_cached_length,
+                             std::chrono::steady_clock::time_point start_time);
+  // FillCell through the span cache
+  void FillCellCached(int start, int length);
+  shared_ptr<Tree<string> > BuildTree(int start, int length, int symbol);
+  pTreeProb BuildCover();
+  bool OverBudget(std::chrono::steady_clock::time_point start_time) const;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "evaluation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+// DFS from left to right, collecting the leaves (or preterminals)
+static vector<string> CollectLeftToRight(Tree<string>* t, bool preterminals) {
+  vector<string> values;
+  stack<Tree<string>*> stack;
+  stack.push(t);
+  while (!stack.empty()) {
+    Tree<string>* node = stack.top();
+    stack.pop();
+    if (preterminals && node->IsPreterminal()) {
+      values.push_back(node->value_);
+      continue;
+    }
+    if (!preterminals && node->IsLeaf()) {
+      values.push_back(node->value_);
+      continue;
+    }
+    for (int i = node->num_children() - 1; i >= 0; i--) {
+      stack.push(node->children_[i].get());
+    }
+  }
+  return values;
+}
+
+vector<string> GetTokens(Tree<string>* t) {
+  return CollectLeftToRight(t, false);
+}
+
+vector<string> GetPosTags(Tree<string>* t) {
+  return CollectLeftToRight(t, true);
+}
+
+vector<tuple<string, int, int> > LabeledBrackets(Tree<string>* t) {
+  vector<tuple<string, int, int> > brackets;
+  // DFS that leaves a node after all its children, with the position of
+  // the node's first token and the next child to visit
+  struct Frame {
+    Tree<string>* node_;
+    int start_;
+    int next_child_;
+  };
+  vector<Frame> stack{{t, 0, 0}};
+  int position = 0;
+  while (!stack.empty()) {
+    Frame& frame = stack.back();
+    Tree<string>* node = frame.node_;
+    if (node->IsLeaf() || node->IsPreterminal()) {
+      position++;
+      stack.pop_back();
+      continue;
+    }
+    if (frame.next_child_ < node->num_children()) {
+      Tree<string>* child = node->children_[frame.next_child_++].get();
+      stack.push_back(Frame{child, position, 0});
+      continue;
+    }
+    if (!IsNormalizationDummy(node)) {
+      string label = node->value_.substr(0, node->value_.find('^'));
+      brackets.push_back(std::make_tuple(label, frame.start_, position));
+    }
+    stack.pop_back();
+  }
+  std::sort(brackets.begin(), brackets.end());
+  return brackets;
+}
+
+EvaluationResult EvaluateParser(DenseParser& parser,
+                                vector<shared_ptr<Tree<string> > > const& gold,
+                                int max_length) {
+  EvaluationResult result;
+  for (shared_ptr<Tree<string> > const& gold_tree : gold) {
+    vector<string> tokens = GetTokens(gold_tree.get());
+    if (tokens.empty() || (int)tokens.size() > max_length) continue;
+    vector<string> gold_tags = GetPosTags(gold_tree.get());
+    shared_ptr<Tree<string> > normalized =
+        ParseTree("( (" + gold_tree->BracketString() + "))");
+    NormalizeTree(normalized.get());
+    vector<tuple<string, int, int> > gold_brackets =
+        LabeledBrackets(normalized.get());
+
+    auto start = std::chrono::steady_clock::now();
+    pTreeProb parsed = parser.Parse(tokens);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    result.num_sentences_++;
+    result.num_tokens_ += tokens.size();
+    result.parse_seconds_ += elapsed.count();
+    result.num_pruned_tags_ += parser.pruned_tags();
+    result.num_tag_fallbacks_ += parser.tag_fallback();
+    result.num_gold_brackets_ += gold_brackets.size();
+    if (parsed.first == nullptr) continue;
+    result.num_parsed_++;
+    vector<string> tags = GetPosTags(parsed.first.get());
+    for (size_t i = 0; i < tags.size() && i < gold_tags.size(); i++) {
+      if (tags[i] == gold_tags[i]) result.num_correct_tags_++;
+    }
+    // Both lists are sorted, the intersection matches equal brackets
+    // at most as often as they occur in either tree
+    vector<tuple<string, int, int> > brackets =
+        LabeledBrackets(parsed.first.get());
+    vector<tuple<string, int, int> > matched;
+    std::set_intersection(brackets.begin(), brackets.end(),
+                          gold_brackets.begin(), gold_brackets.end(),
+                          std::back_inserter(matched));
+    result.num_predicted_brackets_ += brackets.size();
+    result.num_matched_brackets_ += matched.size();
+  }
+  return result;
+}
@@ -0,0 +1,73 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "dense_parser.h"
+#include "tree.h"
+
+using std::string;
+using std::tuple;
+using std::vector;
+
+// Leaves of t from left to right
+vector<string> GetTokens(Tree<string>* t);
+
+// Preterminal labels (POS-tags) of t from left to right
+vector<string> GetPosTags(Tree<string>* t);
+
+struct EvaluationResult {
+  int num_sentences_ = 0;
+  int num_parsed_ = 0;
+  int num_tokens_ = 0;
+  int num_correct_tags_ = 0;
+  // POS-tag pre-pass of the parser (see DenseParser::UseTagger)
+  long num_pruned_tags_ = 0;
+  int num_tag_fallbacks_ = 0;
+  double parse_seconds_ = 0;
+  // Labeled brackets (PARSEVAL), see LabeledBrackets
+  long num_gold_brackets_ = 0;
+  long num_predicted_brackets_ = 0;
+  long num_matched_brackets_ = 0;
+
+  double TagAccuracy() const {
+    return num_tokens_ > 0 ? (double)num_correct_tags_ / num_tokens_ : 0;
+  }
+  double BracketPrecision() const {
+    return num_predicted_brackets_ > 0
+               ? (double)num_matched_brackets_ / num_predicted_brackets_
+               : 0;
+  }
+  double BracketRecall() const {
+    return num_gold_brackets_ > 0
+               ? (double)num_matched_brackets_ / num_gold_brackets_
+               : 0;
+  }
+  double BracketF1() const {
+    double p = BracketPrecision(), r = BracketRecall();
+    return p + r > 0 ? 2 * p * r / (p + r) : 0;
+  }
+  double MillisecondsPerSentence() const {
+    return num_sentences_ > 0 ? 1000 * parse_seconds_ / num_sentences_ : 0;
+  }
+};
+
+// Constituents (label, first token, end token) of t above the POS-tags,
+// sorted. t is read as if denormalized (see DenormalizeTree): dummies are
+// skipped and parent annotations are cut off.
+vector<tuple<string, int, int> > LabeledBrackets(Tree<string>* t);
+
+// Parses the tokens of every gold tree with at most max_length tokens and
+// compares the predicted POS-tags with the gold ones (POS-tag accuracy) and
+// the predicted constituents with the gold ones (labeled bracket precision,
+// recall and F1). The gold trees are compared after NormalizeTree and
+// DenormalizeTree, so the levels the UNIT rule collapses, which no parse
+// can contain, are not counted as missed.
+// Tokens and brackets of sentences without parse count as wrong / missed.
+EvaluationResult EvaluateParser(DenseParser& parser,
+                                vector<shared_ptr<Tree<string> > > const& gold,
+                                int max_length);
+
+#endif
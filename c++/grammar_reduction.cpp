@@ -0,0 +1,143 @@
+#include "grammar_reduction.h"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+using std::map;
+using std::pair;
+using std::set;
+using std::vector;
+
+string CoarseSymbol(string const& symbol) {
+  size_t end = symbol.find('&');
+  string coarse = symbol.substr(0, end);
+  coarse = coarse.substr(0, coarse.find('^'));
+  if (end != string::npos) coarse += "&...";
+  return coarse;
+}
+
+// Drops the rules for which drop(count, count of the left hand side) is
+// true, except the most frequent rule of every left hand side.
+template <typename F>
+static void DropRules(map<Rule, double>& counts, F drop) {
+  map<string, double> totals;
+  // Most frequent rule per left hand side and its count
+  map<string, pair<Rule const*, double> > best;
+  for (auto const& it : counts) {
+    string const& left = it.first.left_;
+    totals[left] += it.second;
+    auto best_it = best.find(left);
+    if (best_it == best.end()) {
+      best[left] = {&it.first, it.second};
+    } else if (it.second > best_it->second.second) {
+      best_it->second = {&it.first, it.second};
+    }
+  }
+  for (auto it = counts.begin(); it != counts.end();) {
+    string const& left = it->first.left_;
+    if (best[left].first != &it->first && drop(it->second, totals[left])) {
+      it = counts.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Interpolates the rule counts of every left hand side with the rules of
+// its coarse symbol (step 2 of ReduceGrammar).
+// Returns the number of added rules.
+static size_t Smooth(map<Rule, double>& counts,
+                     ReductionOptions const& options) {
+  map<string, map<vector<string>, double> > by_left;
+  map<string, map<vector<string>, double> > pools;
+  map<string, double> pool_totals;
+  for (auto const& it : counts) {
+    string coarse = CoarseSymbol(it.first.left_);
+    by_left[it.first.left_][it.first.right_] = it.second;
+    pools[coarse][it.first.right_] += it.second;
+    pool_totals[coarse] += it.second;
+  }
+  double w = options.backoff_weight_;
+  size_t n_added = 0;
+  counts.clear();
+  for (auto const& left_it : by_left) {
+    string const& left = left_it.first;
+    map<vector<string>, double> const& rules = left_it.second;
+    double total = 0;
+    for (auto const& it : rules) total += it.second;
+    string coarse = CoarseSymbol(left);
+    double pool_total = pool_totals[coarse];
+    for (auto const& pool_it : pools[coarse]) {
+      auto it = rules.find(pool_it.first);
+      double count = it != rules.end() ? it->second : 0;
+      double smoothed =
+          (1 - w) * count + w * total * pool_it.second / pool_total;
+      if (count == 0) {
+        if (smoothed < options.min_probability_ * total) continue;
+        n_added++;
+      }
+      Rule rule(left, pool_it.first[0]);
+      rule.right_ = pool_it.first;
+      counts[rule] = smoothed;
+    }
+  }
+  return n_added;
+}
+
+ReductionResult ReduceGrammar(RuleCounts& counts,
+                              ReductionOptions const& options) {
+  ReductionResult result;
+  map<Rule, double>& rules = counts.grammar_counts_;
+  result.rules_before_ = rules.size();
+
+  if (options.min_count_ > 0) {
+    DropRules(rules, [&options](double count, double total) {
+      return count < options.min_count_;
+    });
+  }
+  if (options.backoff_weight_ > 0) {
+    result.backoff_rules_ = Smooth(rules, options);
+  }
+  if (options.min_probability_ > 0) {
+    DropRules(rules, [&options](double count, double total) {
+      return count < options.min_probability_ * total;
+    });
+  }
+
+  // Symbols that still generate words: the POS-tags, then every left hand
+  // side of a rule whose children all do
+  set<string> productive(counts.pos_tags_.begin(), counts.pos_tags_.end());
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto const& it : rules) {
+      if (productive.count(it.first.left_)) continue;
+      bool all = true;
+      for (string const& child : it.first.right_) {
+        all = all && productive.count(child);
+      }
+      if (all) {
+        productive.insert(it.first.left_);
+        changed = true;
+      }
+    }
+  }
+  counts.non_terminals_.clear();
+  for (auto it = rules.begin(); it != rules.end();) {
+    bool all = true;
+    for (string const& child : it->first.right_) {
+      all = all && productive.count(child);
+    }
+    if (all) {
+      counts.non_terminals_.insert(it->first.left_);
+      ++it;
+    } else {
+      it = rules.erase(it);
+      result.unproductive_rules_++;
+    }
+  }
+  result.rules_after_ = rules.size();
+  return result;
+}
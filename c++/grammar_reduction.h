@@ -0,0 +1,54 @@
+#ifndef GRAMMAR_REDUCTION_H
+#define GRAMMAR_REDUCTION_H
+
+#include <string>
+
+#include "pcfg.h"
+
+using std::string;
+
+// Thresholds and smoothing for ReduceGrammar. The defaults change nothing.
+struct ReductionOptions {
+  // Grammar rules seen fewer times are dropped
+  double min_count_ = 0;
+  // Grammar rules with a lower probability (relative frequency given their
+  // left hand side, after smoothing) are dropped
+  double min_probability_ = 0;
+  // Weight of the backoff distribution (see CoarseSymbol) in the smoothed
+  // probabilities, 0 = no smoothing
+  double backoff_weight_ = 0;
+};
+
+struct ReductionResult {
+  size_t rules_before_ = 0;
+  size_t rules_after_ = 0;
+  // Rules added by the smoothing
+  size_t backoff_rules_ = 0;
+  // Rules dropped because a child lost all its rules
+  size_t unproductive_rules_ = 0;
+};
+
+// Symbol whose rules are pooled for the backoff distribution of symbol:
+// parent annotations are cut off and binarization dummies keep only their
+// first child, e.g. "NP^PP" --> "NP", "AP&COORD&PP" --> "AP&...".
+string CoarseSymbol(string const& symbol);
+
+/**
+ * Shrinks (and optionally smooths) the grammar rules of counts in place:
+ * 1. rules seen less than min_count_ times are dropped,
+ * 2. with backoff_weight_ = w > 0, the counts of every left hand side A
+ *    are mixed with the pooled rules of CoarseSymbol(A):
+ *      c'(A -> x) = (1 - w) c(A -> x) + w c(A) P(x | CoarseSymbol(A))
+ *    so that EstimatePCFG gives the interpolated probabilities. Rules of
+ *    the pool that A has not been seen with are added if they reach
+ *    min_probability_ (smoothing without it can grow the grammar a lot),
+ * 3. rules below min_probability_ are dropped,
+ * 4. rules with a child that has no rules left are dropped, repeatedly.
+ * Every left hand side keeps at least its most frequent rule in steps 1
+ * and 3, so no symbol loses all its rules by a threshold. The remaining
+ * counts are renormalized by EstimatePCFG. The lexicon is not changed.
+ */
+ReductionResult ReduceGrammar(RuleCounts& counts,
+                              ReductionOptions const& options);
+
+#endif
@@ -0,0 +1,161 @@
+#include "indexed_grammar.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <tuple>
+
+// Assigns ids in the (sorted) order of the set
+template <typename Map>
+static void IndexSymbols(set<string> const& symbols, vector<string>& names,
+                         Map& ids) {
+  for (string const& symbol : symbols) {
+    ids[symbol] = names.size();
+    names.push_back(symbol);
+  }
+}
+
+template <typename Map>
+static int IdOrMinusOne(Map const& ids, string const& symbol) {
+  auto it = ids.find(symbol);
+  if (it == ids.end()) return -1;
+  return it->second;
+}
+
+IndexedGrammar::IndexedGrammar(PCFG const& pcfg) {
+  // Symbols can also appear in rules only (e.g. binarization dummies that
+  // are never a left handside), so collect them from the rules as well.
+  set<string> non_terms(pcfg.non_terminals_.begin(), pcfg.non_terminals_.end());
+  set<string> pos_tags(pcfg.pos_tags_.begin(), pcfg.pos_tags_.end());
+  set<string> words(pcfg.lexicon_.begin(), pcfg.lexicon_.end());
+  for (auto const& it : pcfg.grammar_probs_) {
+    non_terms.insert(it.first.left_);
+    if (it.first.right_.size() == 2) {
+      non_terms.insert(it.first.right_[0]);
+      non_terms.insert(it.first.right_[1]);
+    } else {
+      pos_tags.insert(it.first.right_[0]);
+    }
+  }
+  for (auto const& it : pcfg.lexicon_probs_) {
+    pos_tags.insert(it.first.left_);
+    words.insert(it.first.right_[0]);
+  }
+  IndexSymbols(non_terms, non_terms_, non_term_ids_);
+  IndexSymbols(pos_tags, pos_tags_, pos_tag_ids_);
+  IndexSymbols(words, words_, word_ids_);
+  BuildWordIndex();
+  root_ = IdOrMinusOne(non_term_ids_, "SENT");
+  unknown_word_ = IdOrMinusOne(word_ids_, "<UNK>");
+
+  // Lexicon, grouped by word
+  vector<tuple<int, int, float> > lexicon;  // word, pos, log prob
+  for (auto const& it : pcfg.lexicon_probs_) {
+    lexicon.push_back(std::make_tuple(word_ids_[it.first.right_[0]],
+                                      pos_tag_ids_[it.first.left_],
+                                      (float)std::log(it.second)));
+  }
+  std::sort(lexicon.begin(), lexicon.end());
+  lexicon_offsets_.assign(num_words() + 1, 0);
+  for (auto const& entry : lexicon) {
+    lexicon_offsets_[std::get<0>(entry) + 1]++;
+    lexicon_pos_.push_back(std::get<1>(entry));
+    lexicon_log_probs_.push_back(std::get<2>(entry));
+  }
+
+  // Unitary and binary grammar rules
+  vector<tuple<int, int, float> > unary;  // pos, parent, log prob
+  vector<tuple<int, int, int, float> > binary;  // left, right, parent, log p
+  for (auto const& it : pcfg.grammar_probs_) {
+    Rule const& rule = it.first;
+    float log_prob = std::log(it.second);
+    int parent = non_term_ids_[rule.left_];
+    if (rule.right_.size() == 2) {
+      binary.push_back(std::make_tuple(non_term_ids_[rule.right_[0]],
+                                       non_term_ids_[rule.right_[1]], parent,
+                                       log_prob));
+    } else {
+      unary.push_back(std::make_tuple(pos_tag_ids_[rule.right_[0]], parent,
+                                      log_prob));
+    }
+  }
+  std::sort(unary.begin(), unary.end());
+  unary_offsets_.assign(num_pos_tags() + 1, 0);
+  for (auto const& entry : unary) {
+    unary_offsets_[std::get<0>(entry) + 1]++;
+    unary_parent_.push_back(std::get<1>(entry));
+    unary_log_probs_.push_back(std::get<2>(entry));
+  }
+  std::sort(binary.begin(), binary.end());
+  left_offsets_.assign(num_non_terms() + 1, 0);
+  for (auto const& entry : binary) {
+    left_offsets_[std::get<0>(entry) + 1]++;
+    binary_left_.push_back(std::get<0>(entry));
+    binary_right_.push_back(std::get<1>(entry));
+    binary_parent_.push_back(std::get<2>(entry));
+    binary_log_probs_.push_back(std::get<3>(entry));
+  }
+
+  // Counts to offsets
+  for (int i = 0; i < num_words(); i++) {
+    lexicon_offsets_[i + 1] += lexicon_offsets_[i];
+  }
+  for (int i = 0; i < num_pos_tags(); i++) {
+    unary_offsets_[i + 1] += unary_offsets_[i];
+  }
+  for (int i = 0; i < num_non_terms(); i++) {
+    left_offsets_[i + 1] += left_offsets_[i];
+  }
+}
+
+void IndexedGrammar::BuildWordIndex() {
+  word_hash_ = PerfectHash(words_);
+  word_of_slot_.assign(words_.size(), 0);
+  for (int w = 0; w < num_words(); w++) {
+    word_of_slot_[word_hash_.Find(words_[w])] = w;
+  }
+}
+
+int IndexedGrammar::WordId(string_view word) const {
+  int slot = word_hash_.Find(word);
+  if (slot < 0) slot = word_hash_.Find(WordSignature(word));
+  if (slot < 0) return unknown_word_;
+  return word_of_slot_[slot];
+}
+
+PCFG IndexedGrammar::ToPCFG(vector<double> const& binary_probs,
+                            vector<double> const& unary_probs,
+                            vector<double> const& lexicon_probs) const {
+  set<string> non_terminals;
+  set<string> pos_tags;
+  set<string> vocab;
+  map<Rule, double> grammar;
+  map<Rule, double> lexicon;
+
+  for (int r = 0; r < num_binary_rules(); r++) {
+    if (binary_probs[r] <= 0) continue;
+    Rule rule(non_terms_[binary_parent_[r]], non_terms_[binary_left_[r]],
+              non_terms_[binary_right_[r]]);
+    grammar[rule] = binary_probs[r];
+    non_terminals.insert(rule.left_);
+  }
+  for (int t = 0; t < num_pos_tags(); t++) {
+    for (int i = unary_offsets_[t]; i < unary_offsets_[t + 1]; i++) {
+      if (unary_probs[i] <= 0) continue;
+      Rule rule(non_terms_[unary_parent_[i]], pos_tags_[t]);
+      grammar[rule] = unary_probs[i];
+      non_terminals.insert(rule.left_);
+    }
+  }
+  for (int w = 0; w < num_words(); w++) {
+    for (int i = lexicon_offsets_[w]; i < lexicon_offsets_[w + 1]; i++) {
+      if (lexicon_probs[i] <= 0) continue;
+      Rule rule(pos_tags_[lexicon_pos_[i]], words_[w]);
+      lexicon[rule] = lexicon_probs[i];
+      pos_tags.insert(rule.left_);
+      if (w != unknown_word_) vocab.insert(words_[w]);
+    }
+  }
+  return PCFG(non_terminals, pos_tags, vocab, lexicon, grammar);
+}
@@ -0,0 +1,97 @@
+#ifndef INDEXED_GRAMMAR_H
+#define INDEXED_GRAMMAR_H
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pcfg.h"
+#include "perfect_hash.h"
+
+using std::map;
+using std::string;
+using std::string_view;
+using std::vector;
+
+// The same PCFG as the string based one, but with every symbol replaced by
+// an integer id and the rules stored in flat arrays (structure of arrays).
+// This is the representation the numeric engines (inside-outside, dense
+// CYK) run on: no string compares and no pointer chasing in the inner loops.
+//
+// Ids are dense per symbol type, i.e. NonTerms, POS-tags and words each
+// have their own id space starting at 0.
+// All probabilities are stored as natural logarithms.
+//
+// This is also the frozen grammar that parser threads share: once built it
+// is only read through const references (DenseParser, BatchParser,
+// DocumentPipeline). Rules of a symbol are contiguous ranges of the arrays
+// below, and WordId needs no allocation beyond the short signature string
+// of an unknown word, so any number of threads can use one instance
+// without locks.
+class IndexedGrammar {
+ public:
+  vector<string> non_terms_;
+  vector<string> pos_tags_;
+  vector<string> words_;
+  map<string, int> non_term_ids_;
+  map<string, int> pos_tag_ids_;
+  map<string, int, std::less<> > word_ids_;
+  // O(1) word lookup for WordId: slot --> word id
+  PerfectHash word_hash_;
+  vector<int> word_of_slot_;
+
+  // Id of the start symbol SENT (-1 if the grammar has none)
+  int root_;
+  // Id of the artificial word <UNK> that every POS-tag can emit
+  // (-1 if the grammar has none)
+  int unknown_word_;
+
+  // Lexicon rules POS-tag -> word, grouped by word:
+  // word w is generated by lexicon_pos_[i] for
+  // i in [lexicon_offsets_[w], lexicon_offsets_[w+1])
+  vector<int> lexicon_offsets_;
+  vector<int> lexicon_pos_;
+  vector<float> lexicon_log_probs_;
+
+  // Unitary rules NonTerm -> POS-tag, grouped by POS-tag:
+  // POS-tag t is generated by unary_parent_[i] for
+  // i in [unary_offsets_[t], unary_offsets_[t+1])
+  vector<int> unary_offsets_;
+  vector<int> unary_parent_;
+  vector<float> unary_log_probs_;
+
+  // Binary rules parent -> (left, right), sorted by (left, right, parent).
+  // Rules with left child B are in [left_offsets_[B], left_offsets_[B+1])
+  vector<int> binary_parent_;
+  vector<int> binary_left_;
+  vector<int> binary_right_;
+  vector<float> binary_log_probs_;
+  vector<int> left_offsets_;
+
+  IndexedGrammar() : root_(-1), unknown_word_(-1) { ; }
+  IndexedGrammar(PCFG const& pcfg);
+
+  int num_non_terms() const { return non_terms_.size(); }
+  int num_pos_tags() const { return pos_tags_.size(); }
+  int num_words() const { return words_.size(); }
+  int num_binary_rules() const { return binary_parent_.size(); }
+  int num_unary_rules() const { return unary_parent_.size(); }
+  int num_lexicon_rules() const { return lexicon_pos_.size(); }
+
+  // (Re)builds word_hash_ from words_
+  void BuildWordIndex();
+  // Id of the given word. Words that are not in the lexicon get the id of
+  // their signature (see WordSignature) if the grammar has it, otherwise
+  // unknown_word_.
+  int WordId(string_view word) const;
+
+  // Converts the rules (with new probabilities) back to the string based
+  // representation, e.g. after re-estimation.
+  // Rules with a probability of 0 are left out.
+  PCFG ToPCFG(vector<double> const& binary_probs,
+              vector<double> const& unary_probs,
+              vector<double> const& lexicon_probs) const;
+};
+
+#endif
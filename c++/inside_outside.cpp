@@ -0,0 +1,388 @@
+#include "inside_outside.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+static const double kLogZero = -std::numeric_limits<double>::infinity();
+
+// acc[r] += weight * probs[r] * values[index[r]]  for r in [begin, end)
+__attribute__((target_clones("avx2", "default")))
+static void AddWeightedGather(float* acc, float const* probs,
+                              int const* index, float const* values,
+                              float weight, int begin, int end) {
+  for (int r = begin; r < end; r++) {
+    acc[r] += weight * probs[r] * values[index[r]];
+  }
+}
+
+// acc[r] += weight * probs[r] * a[index_a[r]] * b[index_b[r]]
+__attribute__((target_clones("avx2", "default")))
+static void AddWeightedGather2(float* acc, float const* probs,
+                               int const* index_a, float const* a,
+                               int const* index_b, float const* b,
+                               float weight, int begin, int end) {
+  for (int r = begin; r < end; r++) {
+    acc[r] += weight * probs[r] * a[index_a[r]] * b[index_b[r]];
+  }
+}
+
+// Divides all values by their maximum.
+// Returns the log of that maximum, or kLogZero if all values are 0.
+static double Normalize(float* values, int n) {
+  float max = 0;
+  for (int i = 0; i < n; i++) {
+    max = std::max(max, values[i]);
+  }
+  if (max <= 0) return kLogZero;
+  float inverse = 1.0f / max;
+  for (int i = 0; i < n; i++) {
+    values[i] *= inverse;
+  }
+  return std::log((double)max);
+}
+
+ExpectedCounts::ExpectedCounts(IndexedGrammar const& grammar)
+    : binary_(grammar.num_binary_rules(), 0.0),
+      unary_(grammar.num_unary_rules(), 0.0),
+      lexicon_(grammar.num_lexicon_rules(), 0.0),
+      log_likelihood_(0.0),
+      num_parsed_(0) {}
+
+void ExpectedCounts::Add(ExpectedCounts const& other) {
+  for (size_t i = 0; i < binary_.size(); i++) binary_[i] += other.binary_[i];
+  for (size_t i = 0; i < unary_.size(); i++) unary_[i] += other.unary_[i];
+  for (size_t i = 0; i < lexicon_.size(); i++) lexicon_[i] += other.lexicon_[i];
+  log_likelihood_ += other.log_likelihood_;
+  num_parsed_ += other.num_parsed_;
+}
+
+InsideOutside::InsideOutside(IndexedGrammar const& grammar)
+    : grammar_(grammar), n_(0), n_non_terms_(grammar.num_non_terms()) {
+  for (float log_prob : grammar.binary_log_probs_) {
+    binary_probs_.push_back(std::exp(log_prob));
+  }
+  for (float log_prob : grammar.unary_log_probs_) {
+    unary_probs_.push_back(std::exp(log_prob));
+  }
+  for (float log_prob : grammar.lexicon_log_probs_) {
+    lexicon_probs_.push_back(std::exp(log_prob));
+  }
+  for (int b = 0; b < n_non_terms_; b++) {
+    if (grammar.left_offsets_[b] < grammar.left_offsets_[b + 1]) {
+      left_symbols_.push_back(b);
+    }
+  }
+  rule_acc_.resize(grammar.num_binary_rules());
+  rule_acc_right_.resize(grammar.num_binary_rules());
+  sentence_counts_.resize(grammar.num_binary_rules());
+}
+
+void InsideOutside::Reset(vector<string> const& tokens) {
+  n_ = tokens.size();
+  word_ids_.clear();
+  for (string const& token : tokens) {
+    word_ids_.push_back(grammar_.WordId(token));
+  }
+  // Spans of length l start at 0, ..., n-l
+  row_offsets_.assign(n_ + 2, 0);
+  for (int length = 1; length <= n_; length++) {
+    row_offsets_[length + 1] = row_offsets_[length] + n_ - length + 1;
+  }
+  int n_cells = row_offsets_[n_ + 1];
+  inside_.assign((size_t)n_cells * n_non_terms_, 0.0f);
+  outside_.assign((size_t)n_cells * n_non_terms_, 0.0f);
+  inside_scale_.assign(n_cells, kLogZero);
+  outside_scale_.assign(n_cells, kLogZero);
+}
+
+void InsideOutside::ComputeInside() {
+  IndexedGrammar const& g = grammar_;
+
+  // Spans of length 1: NonTerm -> POS-tag -> word
+  for (int i = 0; i < n_; i++) {
+    int c = Cell(i, 1);
+    int w = word_ids_[i];
+    if (w < 0) continue;
+    float* in = Inside(c);
+    for (int e = g.lexicon_offsets_[w]; e < g.lexicon_offsets_[w + 1]; e++) {
+      int t = g.lexicon_pos_[e];
+      for (int j = g.unary_offsets_[t]; j < g.unary_offsets_[t + 1]; j++) {
+        in[g.unary_parent_[j]] += unary_probs_[j] * lexicon_probs_[e];
+      }
+    }
+    inside_scale_[c] = Normalize(in, n_non_terms_);
+  }
+
+  // Longer spans: A -> B C with B over [start, start+left_length) and C over
+  // the rest.
+  for (int length = 2; length <= n_; length++) {
+    for (int start = 0; start + length <= n_; start++) {
+      int c = Cell(start, length);
+      // Common scale of all splits
+      double target = kLogZero;
+      for (int left_length = 1; left_length < length; left_length++) {
+        double scale = inside_scale_[Cell(start, left_length)] +
+            inside_scale_[Cell(start + left_length, length - left_length)];
+        target = std::max(target, scale);
+      }
+      if (target == kLogZero) continue;
+
+      std::fill(rule_acc_.begin(), rule_acc_.end(), 0.0f);
+      for (int left_length = 1; left_length < length; left_length++) {
+        int left = Cell(start, left_length);
+        int right = Cell(start + left_length, length - left_length);
+        double scale = inside_scale_[left] + inside_scale_[right];
+        if (scale == kLogZero) continue;
+        float factor = std::exp(scale - target);
+        float* in_left = Inside(left);
+        float* in_right = Inside(right);
+        for (int b : left_symbols_) {
+          if (in_left[b] == 0) continue;
+          AddWeightedGather(rule_acc_.data(), binary_probs_.data(),
+                            g.binary_right_.data(), in_right,
+                            factor * in_left[b], g.left_offsets_[b],
+                            g.left_offsets_[b + 1]);
+        }
+      }
+      float* in = Inside(c);
+      for (int r = 0; r < g.num_binary_rules(); r++) {
+        in[g.binary_parent_[r]] += rule_acc_[r];
+      }
+      inside_scale_[c] = target + Normalize(in, n_non_terms_);
+    }
+  }
+}
+
+/**
+ * Top down, every cell collects its outside values from all (already
+ * complete) longer cells it can be a left or a right child of.
+ * Only symbols with a non zero inside value need an outside value, as all
+ * others cannot take part in any parse.
+ */
+void InsideOutside::ComputeOutside() {
+  IndexedGrammar const& g = grammar_;
+  int top = Cell(0, n_);
+  Outside(top)[g.root_] = 1.0f;
+  outside_scale_[top] = 0.0;
+
+  for (int length = n_ - 1; length >= 1; length--) {
+    for (int start = 0; start + length <= n_; start++) {
+      int c = Cell(start, length);
+      if (inside_scale_[c] == kLogZero) continue;
+
+      // (parent, sibling) cells: c as left child, then c as right child
+      vector<pair<int, int> > left_role;
+      vector<pair<int, int> > right_role;
+      double target = kLogZero;
+      for (int m = 1; start + length + m <= n_; m++) {
+        int parent = Cell(start, length + m);
+        int sibling = Cell(start + length, m);
+        double scale = outside_scale_[parent] + inside_scale_[sibling];
+        if (scale == kLogZero) continue;
+        left_role.push_back(pair<int, int>(parent, sibling));
+        target = std::max(target, scale);
+      }
+      for (int m = 1; m <= start; m++) {
+        int parent = Cell(start - m, length + m);
+        int sibling = Cell(start - m, m);
+        double scale = outside_scale_[parent] + inside_scale_[sibling];
+        if (scale == kLogZero) continue;
+        right_role.push_back(pair<int, int>(parent, sibling));
+        target = std::max(target, scale);
+      }
+      if (target == kLogZero) continue;
+
+      float* in = Inside(c);
+      std::fill(rule_acc_.begin(), rule_acc_.end(), 0.0f);
+      std::fill(rule_acc_right_.begin(), rule_acc_right_.end(), 0.0f);
+      for (pair<int, int> const& ps : left_role) {
+        float factor = std::exp(outside_scale_[ps.first] +
+                                inside_scale_[ps.second] - target);
+        for (int b : left_symbols_) {
+          if (in[b] == 0) continue;
+          AddWeightedGather2(rule_acc_.data(), binary_probs_.data(),
+                             g.binary_parent_.data(), Outside(ps.first),
+                             g.binary_right_.data(), Inside(ps.second),
+                             factor, g.left_offsets_[b],
+                             g.left_offsets_[b + 1]);
+        }
+      }
+      for (pair<int, int> const& ps : right_role) {
+        float factor = std::exp(outside_scale_[ps.first] +
+                                inside_scale_[ps.second] - target);
+        float* in_sibling = Inside(ps.second);
+        for (int b : left_symbols_) {
+          if (in_sibling[b] == 0) continue;
+          AddWeightedGather(rule_acc_right_.data(), binary_probs_.data(),
+                            g.binary_parent_.data(), Outside(ps.first),
+                            factor * in_sibling[b], g.left_offsets_[b],
+                            g.left_offsets_[b + 1]);
+        }
+      }
+
+      float* out = Outside(c);
+      for (int r = 0; r < g.num_binary_rules(); r++) {
+        out[g.binary_left_[r]] += rule_acc_[r];
+        out[g.binary_right_[r]] += rule_acc_right_[r];
+      }
+      outside_scale_[c] = target + Normalize(out, n_non_terms_);
+    }
+  }
+}
+
+/**
+ * The expected count of a rule application is
+ * outside(parent) * p(rule) * inside(children) / p(sentence)
+ */
+void InsideOutside::CollectCounts(double log_z, ExpectedCounts& counts) {
+  IndexedGrammar const& g = grammar_;
+
+  std::fill(sentence_counts_.begin(), sentence_counts_.end(), 0.0f);
+  for (int length = 2; length <= n_; length++) {
+    for (int start = 0; start + length <= n_; start++) {
+      int c = Cell(start, length);
+      if (outside_scale_[c] == kLogZero) continue;
+      for (int left_length = 1; left_length < length; left_length++) {
+        int left = Cell(start, left_length);
+        int right = Cell(start + left_length, length - left_length);
+        double scale = outside_scale_[c] + inside_scale_[left] +
+                       inside_scale_[right];
+        if (scale == kLogZero) continue;
+        double factor = std::exp(scale - log_z);
+        float* in_left = Inside(left);
+        for (int b : left_symbols_) {
+          if (in_left[b] == 0) continue;
+          AddWeightedGather2(sentence_counts_.data(), binary_probs_.data(),
+                             g.binary_parent_.data(), Outside(c),
+                             g.binary_right_.data(), Inside(right),
+                             factor * in_left[b], g.left_offsets_[b],
+                             g.left_offsets_[b + 1]);
+        }
+      }
+    }
+  }
+  for (int r = 0; r < g.num_binary_rules(); r++) {
+    counts.binary_[r] += sentence_counts_[r];
+  }
+
+  for (int i = 0; i < n_; i++) {
+    int c = Cell(i, 1);
+    int w = word_ids_[i];
+    if (w < 0 || outside_scale_[c] == kLogZero) continue;
+    double factor = std::exp(outside_scale_[c] - log_z);
+    float* out = Outside(c);
+    for (int e = g.lexicon_offsets_[w]; e < g.lexicon_offsets_[w + 1]; e++) {
+      int t = g.lexicon_pos_[e];
+      double pos_count = 0;
+      for (int j = g.unary_offsets_[t]; j < g.unary_offsets_[t + 1]; j++) {
+        double count = factor * out[g.unary_parent_[j]] * unary_probs_[j] *
+                       lexicon_probs_[e];
+        counts.unary_[j] += count;
+        pos_count += count;
+      }
+      counts.lexicon_[e] += pos_count;
+    }
+  }
+}
+
+bool InsideOutside::AddExpectedCounts(vector<string> const& tokens,
+                                      ExpectedCounts& counts) {
+  if (tokens.empty() || grammar_.root_ < 0) return false;
+  Reset(tokens);
+  ComputeInside();
+  int top = Cell(0, n_);
+  float root_inside = Inside(top)[grammar_.root_];
+  if (root_inside <= 0) return false;
+  double log_z = std::log((double)root_inside) + inside_scale_[top];
+
+  ComputeOutside();
+  CollectCounts(log_z, counts);
+  counts.log_likelihood_ += log_z;
+  counts.num_parsed_++;
+  return true;
+}
+
+ExpectedCounts ComputeExpectedCounts(IndexedGrammar const& grammar,
+                                     vector<vector<string> > const& sentences,
+                                     int num_threads, int max_length) {
+  num_threads = std::max(1, num_threads);
+  vector<ExpectedCounts> thread_counts(num_threads, ExpectedCounts(grammar));
+  std::atomic<int> next_sentence(0);
+
+  auto worker = [&](int thread_id) {
+    InsideOutside engine(grammar);
+    ExpectedCounts& counts = thread_counts[thread_id];
+    int i;
+    while ((i = next_sentence++) < (int)sentences.size()) {
+      if ((int)sentences[i].size() > max_length) continue;
+      engine.AddExpectedCounts(sentences[i], counts);
+    }
+  };
+  vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++) {
+    threads.push_back(std::thread(worker, t));
+  }
+  worker(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 1; t < num_threads; t++) {
+    thread_counts[0].Add(thread_counts[t]);
+  }
+  return thread_counts[0];
+}
+
+PCFG ReestimatePCFG(IndexedGrammar const& grammar,
+                    ExpectedCounts const& counts) {
+  IndexedGrammar const& g = grammar;
+  vector<double> non_term_totals(g.num_non_terms(), 0.0);
+  vector<double> pos_totals(g.num_pos_tags(), 0.0);
+  for (int r = 0; r < g.num_binary_rules(); r++) {
+    non_term_totals[g.binary_parent_[r]] += counts.binary_[r];
+  }
+  for (int j = 0; j < g.num_unary_rules(); j++) {
+    non_term_totals[g.unary_parent_[j]] += counts.unary_[j];
+  }
+  for (int e = 0; e < g.num_lexicon_rules(); e++) {
+    pos_totals[g.lexicon_pos_[e]] += counts.lexicon_[e];
+  }
+
+  vector<double> binary_probs(g.num_binary_rules());
+  vector<double> unary_probs(g.num_unary_rules());
+  vector<double> lexicon_probs(g.num_lexicon_rules());
+  for (int r = 0; r < g.num_binary_rules(); r++) {
+    double total = non_term_totals[g.binary_parent_[r]];
+    binary_probs[r] = total > 0 ? counts.binary_[r] / total
+                                : std::exp(g.binary_log_probs_[r]);
+  }
+  for (int j = 0; j < g.num_unary_rules(); j++) {
+    double total = non_term_totals[g.unary_parent_[j]];
+    unary_probs[j] = total > 0 ? counts.unary_[j] / total
+                               : std::exp(g.unary_log_probs_[j]);
+  }
+  for (int e = 0; e < g.num_lexicon_rules(); e++) {
+    double total = pos_totals[g.lexicon_pos_[e]];
+    lexicon_probs[e] = total > 0 ? counts.lexicon_[e] / total
+                                 : std::exp(g.lexicon_log_probs_[e]);
+  }
+  return g.ToPCFG(binary_probs, unary_probs, lexicon_probs);
+}
+
+PCFG TrainEM(PCFG const& initial, vector<vector<string> > const& sentences,
+             int iterations, int num_threads, int max_length) {
+  PCFG pcfg = initial;
+  for (int iteration = 1; iteration <= iterations; iteration++) {
+    IndexedGrammar grammar(pcfg);
+    ExpectedCounts counts =
+        ComputeExpectedCounts(grammar, sentences, num_threads, max_length);
+    printf("EM iteration %i: log likelihood %.4f (%i/%zu sentences parsed)\n",
+           iteration, counts.log_likelihood_, counts.num_parsed_,
+           sentences.size());
+    pcfg = ReestimatePCFG(grammar, counts);
+  }
+  return pcfg;
+}
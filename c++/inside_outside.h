@@ -0,0 +1,100 @@
+#ifndef INSIDE_OUTSIDE_H
+#define INSIDE_OUTSIDE_H
+
+#include <string>
+#include <vector>
+
+#include "indexed_grammar.h"
+#include "pcfg.h"
+
+using std::string;
+using std::vector;
+
+// Expected number of times every rule of an IndexedGrammar is used when the
+// grammar generates a set of sentences. Entries are indexed like the rule
+// arrays of the grammar.
+struct ExpectedCounts {
+  vector<double> binary_;
+  vector<double> unary_;
+  vector<double> lexicon_;
+  // Sum of the log probabilities of the parsed sentences
+  double log_likelihood_;
+  int num_parsed_;
+
+  ExpectedCounts(IndexedGrammar const& grammar);
+  void Add(ExpectedCounts const& other);
+};
+
+// Inside-outside algorithm (Lari & Young, 1990) over an IndexedGrammar.
+// Computes for an unannotated sentence how often every rule is used in
+// expectation over all of its parse trees.
+//
+// The chart stores per cell (span) one float per NonTerm plus a log scale
+// factor for the whole cell, i.e. the real inside value of symbol A over
+// span c is inside_[c][A] * exp(inside_scale_[c]). This keeps every cell
+// within float range no matter how long the sentence is, without paying for
+// a log-sum-exp per rule.
+// The inner loops run over contiguous rule arrays, so the compiler can
+// vectorize them (gathers on AVX2 machines).
+//
+// An instance keeps its buffers between sentences and must not be shared
+// between threads.
+class InsideOutside {
+ public:
+  InsideOutside(IndexedGrammar const& grammar);
+
+  // Adds the expected rule counts of the sentence to counts.
+  // Returns false (and adds nothing) if the grammar cannot generate the
+  // sentence from its start symbol.
+  bool AddExpectedCounts(vector<string> const& tokens, ExpectedCounts& counts);
+
+ private:
+  IndexedGrammar const& grammar_;
+  int n_;
+  int n_non_terms_;
+  vector<float> binary_probs_;
+  vector<float> unary_probs_;
+  vector<float> lexicon_probs_;
+
+  // NonTerms that are the left child of at least one binary rule
+  vector<int> left_symbols_;
+  vector<int> word_ids_;
+  // Offset of the first cell of spans with the given length
+  vector<int> row_offsets_;
+  vector<float> inside_;
+  vector<float> outside_;
+  vector<double> inside_scale_;
+  vector<double> outside_scale_;
+  // One entry per binary rule, reused for every cell
+  vector<float> rule_acc_;
+  vector<float> rule_acc_right_;
+  vector<float> sentence_counts_;
+
+  int Cell(int start, int length) { return row_offsets_[length] + start; }
+  float* Inside(int cell) { return &inside_[(size_t)cell * n_non_terms_]; }
+  float* Outside(int cell) { return &outside_[(size_t)cell * n_non_terms_]; }
+  void Reset(vector<string> const& tokens);
+  void ComputeInside();
+  void ComputeOutside();
+  void CollectCounts(double log_z, ExpectedCounts& counts);
+};
+
+// E-step: Sums up the expected rule counts over all sentences.
+// Sentences are distributed over num_threads threads, sentences with more
+// than max_length tokens are skipped.
+ExpectedCounts ComputeExpectedCounts(IndexedGrammar const& grammar,
+                                     vector<vector<string> > const& sentences,
+                                     int num_threads, int max_length);
+
+// M-step: Relative frequency estimate from the expected counts.
+// NonTerms and POS-tags that were never used keep their old probabilities.
+PCFG ReestimatePCFG(IndexedGrammar const& grammar,
+                    ExpectedCounts const& counts);
+
+// Expectation maximization on raw (unannotated) sentences, starting from a
+// (e.g. treebank trained) PCFG. Runs the given number of iterations and
+// returns the re-estimated PCFG.
+PCFG TrainEM(PCFG const& initial, vector<vector<string> > const& sentences,
+             int iterations, int num_threads = 1, int max_length = 40);
+
+#endif
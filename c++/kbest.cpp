@@ -0,0 +1,141 @@
+#include "kbest.h"
+
+#include <algorithm>
+#include <limits>
+
+int Hypergraph::AddNode(string symbol) {
+  Node node;
+  node.symbol_ = symbol;
+  node.viterbi_log_prob_ = -std::numeric_limits<double>::infinity();
+  nodes_.push_back(node);
+  return nodes_.size() - 1;
+}
+
+void Hypergraph::AddEdge(int head, double log_weight,
+                         vector<int> const& tails) {
+  Hyperedge e;
+  e.head_ = head;
+  e.log_weight_ = log_weight;
+  e.tails_ = tails;
+  edges_.push_back(e);
+  nodes_[head].in_edges_.push_back(edges_.size() - 1);
+
+  // Tails are complete already (bottom up construction), so the Viterbi
+  // score of the head can be updated right away.
+  double log_prob = log_weight;
+  for (int tail : tails) {
+    log_prob += nodes_[tail].viterbi_log_prob_;
+  }
+  if (log_prob > nodes_[head].viterbi_log_prob_) {
+    nodes_[head].viterbi_log_prob_ = log_prob;
+  }
+}
+
+/**
+ * Log probability of the rank-th best derivation of v.
+ * The best derivation is known from construction, all others have to be
+ * enumerated by LazyKthBest before.
+ */
+double Hypergraph::RankedLogProb(int v, int rank) {
+  if (rank == 0) return nodes_[v].viterbi_log_prob_;
+  return nodes_[v].derivations_[rank].log_prob_;
+}
+
+double Hypergraph::DerivationLogProb(int edge, vector<int> const& ranks) {
+  Hyperedge const& e = edges_[edge];
+  double log_prob = e.log_weight_;
+  for (size_t i = 0; i < e.tails_.size(); i++) {
+    log_prob += RankedLogProb(e.tails_[i], ranks[i]);
+  }
+  return log_prob;
+}
+
+/**
+ * Fills cand(v) with the best derivation along every incoming edge.
+ */
+void Hypergraph::InitCandidates(int v) {
+  Node& node = nodes_[v];
+  for (int edge : node.in_edges_) {
+    Derivation d;
+    d.edge_ = edge;
+    d.ranks_ = vector<int>(edges_[edge].tails_.size(), 0);
+    d.log_prob_ = DerivationLogProb(edge, d.ranks_);
+    node.seen_.insert(pair<int, vector<int> >(d.edge_, d.ranks_));
+    node.candidates_.push(d);
+  }
+  node.candidates_initialized_ = true;
+}
+
+/**
+ * Makes sure that the k best derivations of v are enumerated in D(v)
+ * (or all of them if there are fewer than k).
+ */
+void Hypergraph::LazyKthBest(int v, int k) {
+  if (!nodes_[v].candidates_initialized_) {
+    InitCandidates(v);
+  }
+  while (static_cast<int>(nodes_[v].derivations_.size()) < k) {
+    if (nodes_[v].derivations_.size() > 0) {
+      LazyNext(v, nodes_[v].derivations_.back());
+    }
+    if (nodes_[v].candidates_.empty()) break;
+    nodes_[v].derivations_.push_back(nodes_[v].candidates_.top());
+    nodes_[v].candidates_.pop();
+  }
+}
+
+/**
+ * Pushes the neighbours of derivation d to cand(v): for every tail one
+ * derivation that uses the next worse subderivation of that tail.
+ */
+void Hypergraph::LazyNext(int v, Derivation const& d) {
+  vector<int> const& tails = edges_[d.edge_].tails_;
+  for (size_t i = 0; i < tails.size(); i++) {
+    vector<int> ranks = d.ranks_;
+    ranks[i]++;
+    LazyKthBest(tails[i], ranks[i] + 1);
+    int available = nodes_[tails[i]].derivations_.size();
+    if (ranks[i] >= available) continue;
+
+    pair<int, vector<int> > key(d.edge_, ranks);
+    if (nodes_[v].seen_.count(key) > 0) continue;
+    nodes_[v].seen_.insert(key);
+
+    Derivation next;
+    next.edge_ = d.edge_;
+    next.ranks_ = ranks;
+    next.log_prob_ = DerivationLogProb(d.edge_, ranks);
+    nodes_[v].candidates_.push(next);
+  }
+}
+
+shared_ptr<Tree<string> > Hypergraph::BuildTree(int v, int rank) {
+  LazyKthBest(v, rank + 1);
+  Derivation const d = nodes_[v].derivations_[rank];
+  Hyperedge const& e = edges_[d.edge_];
+
+  // Virtual nodes are replaced by their only child
+  if (nodes_[v].symbol_.empty() && e.tails_.size() == 1) {
+    return BuildTree(e.tails_[0], d.ranks_[0]);
+  }
+
+  auto tree = make_shared<Tree<string> >(nodes_[v].symbol_);
+  for (size_t i = 0; i < e.tails_.size(); i++) {
+    shared_ptr<Tree<string> > child = BuildTree(e.tails_[i], d.ranks_[i]);
+    child->parent_ = tree->weak_from_this();
+    tree->AddChild(child);
+  }
+  return tree;
+}
+
+vector<pTreeProb> Hypergraph::KBest(int v, int k) {
+  vector<pTreeProb> result;
+  if (k <= 0 || !HasDerivation(v)) return result;
+  LazyKthBest(v, k);
+  int n_found = std::min<int>(k, nodes_[v].derivations_.size());
+  for (int rank = 0; rank < n_found; rank++) {
+    double log_prob = nodes_[v].derivations_[rank].log_prob_;
+    result.push_back(pTreeProb(BuildTree(v, rank), log_prob));
+  }
+  return result;
+}
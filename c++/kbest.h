@@ -0,0 +1,88 @@
+#ifndef KBEST_H
+#define KBEST_H
+
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tree.h"
+
+using std::set;
+using std::string;
+using std::vector;
+
+// Hyperedge of a parse forest: the head symbol dissolves into the tails.
+// log_weight_: log probability of the rule that was applied
+// tails_: child nodes, empty for tokens (axioms)
+struct Hyperedge {
+  int head_;
+  double log_weight_;
+  vector<int> tails_;
+};
+
+// Packed parse forest of all derivations found by a CYK chart, with lazy
+// k-best extraction following Huang & Chiang (2005), "Better k-best Parsing",
+// Algorithm 3.
+// Nodes have to be added bottom up (children before parents), which is the
+// order in which the CYK table is filled anyway. This lets us compute the
+// 1-best (Viterbi) score of every node while the forest is built. The k-th
+// best derivations are only enumerated on demand, starting at the root, so
+// the price for k is paid only for nodes that actually take part in one of
+// the k best trees.
+class Hypergraph {
+ public:
+  // Adds a node labeled with symbol (NonTerm, PosTag or Token).
+  // Nodes with an empty symbol are virtual: they do not show up in the
+  // returned trees (e.g. a super root joining all symbols of the top cell).
+  int AddNode(string symbol);
+  // Adds the hyperedge head -> tails. All tails must already have at least
+  // one incoming edge.
+  void AddEdge(int head, double log_weight, vector<int> const& tails);
+  int num_nodes() { return nodes_.size(); }
+  bool HasDerivation(int v) { return !nodes_[v].in_edges_.empty(); }
+
+  // Returns the (at most) k most likely trees rooted at v together with their
+  // log probabilities, best first.
+  vector<pTreeProb> KBest(int v, int k);
+
+ private:
+  // A derivation is an incoming edge plus the rank of the derivation used
+  // for every tail, e.g. ranks_ = {0, 2} uses the best derivation of the left
+  // child and the third best of the right child.
+  struct Derivation {
+    int edge_;
+    vector<int> ranks_;
+    double log_prob_;
+  };
+  struct WorseDerivation {
+    bool operator()(Derivation const& a, Derivation const& b) const {
+      return a.log_prob_ < b.log_prob_;
+    }
+  };
+  struct Node {
+    string symbol_;
+    vector<int> in_edges_;
+    double viterbi_log_prob_;
+    bool candidates_initialized_ = false;
+    // D(v) in the paper: derivations found so far, best first
+    vector<Derivation> derivations_;
+    // cand(v) in the paper: frontier of the next best derivations
+    std::priority_queue<Derivation, vector<Derivation>, WorseDerivation>
+        candidates_;
+    // (edge, ranks) pairs that were already pushed to candidates_
+    set<pair<int, vector<int> > > seen_;
+  };
+
+  vector<Node> nodes_;
+  vector<Hyperedge> edges_;
+
+  double RankedLogProb(int v, int rank);
+  double DerivationLogProb(int edge, vector<int> const& ranks);
+  void InitCandidates(int v);
+  void LazyKthBest(int v, int k);
+  void LazyNext(int v, Derivation const& d);
+  shared_ptr<Tree<string> > BuildTree(int v, int rank);
+};
+
+#endif
@@ -4,15 +4,32 @@
  * Author: Lucas Elbert
  */
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <fstream>
 #include <memory>
+#include <random>
+#include <thread>
 
+#include "batch_parser.h"
+#include "compact_grammar.h"
+#include "dense_parser.h"
+#include "evaluation.h"
+#include "grammar_reduction.h"
+#include "inside_outside.h"
+#include "parse_cache.h"
+#include "parse_session.h"
 #include "pcfg.h"
+#include "pipeline.h"
+#include "pos_tagger.h"
+#include "tokenizer.h"
 #include "tree.h"
+#include "tree_writer.h"
 #include "utils.h"
 
 using namespace std;
@@ -30,30 +47,632 @@ shared_ptr<Tree<string> > foo() {
   return t1;
 }
 
-int main() {
-  ifstream infile("../data/sequoia-corpus+fct.mrg_strict");
-  string line;
+// Compares grammar size, parse speed, POS-tag accuracy and labeled bracket
+// F1 for several markovization orders. Trains on the first 90% of the
+// treebank lines and evaluates on the last 10% (sentences up to 40 tokens).
+void MarkovReport(vector<string> const& lines) {
+  int n_train = 0.9 * lines.size();
+  vector<shared_ptr<Tree<string> > > gold;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    gold.push_back(ParseTree(lines[i]));
+  }
+
+  // (horizontal, vertical), horizontal -1 = unbounded (no markovization)
+  vector<pair<int, int> > orders{{-1, 1}, {3, 1}, {2, 1}, {1, 1}, {0, 1},
+                                 {-1, 2}, {2, 2}, {1, 2}};
+  printf("%4s %4s %10s %10s %12s %10s %10s %10s\n", "h", "v", "non terms",
+         "bin rules", "ms/sentence", "tag acc", "bracket F1", "parsed");
+  for (pair<int, int> order : orders) {
+    vector<shared_ptr<Tree<string> > > trees;
+    for (int i = 0; i < n_train; i++) {
+      shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+      NormalizeTree(t.get(), order.first, order.second);
+      trees.push_back(t);
+    }
+    PCFG pcfg = InferePCFG(trees);
+    IndexedGrammar grammar(pcfg);
+    DenseParser parser(grammar);
+    EvaluationResult result = EvaluateParser(parser, gold, 40);
+    printf("%4i %4i %10i %10i %12.2f %10.4f %10.4f %5i/%i\n", order.first,
+           order.second, grammar.num_non_terms(), grammar.num_binary_rules(),
+           result.MillisecondsPerSentence(), result.TagAccuracy(),
+           result.BracketF1(), result.num_parsed_, result.num_sentences_);
+  }
+}
+
+// Memory footprint of the PCFG and of the IndexedGrammar the parsers run
+// on, the size of the compact grammar files, and the effect of the 16-bit
+// log probabilities on the parses of the last 10% of the treebank.
+void CompactReport(vector<string> const& lines) {
+  int n_train = 0.9 * lines.size();
   vector<shared_ptr<Tree<string> > > trees;
-  while (getline(infile, line)) {
-    shared_ptr<Tree<string> > t = ParseTree(line);
+  for (int i = 0; i < n_train; i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+    NormalizeTree(t.get());
     trees.push_back(t);
+  }
+  PCFG pcfg = InferePCFG(trees);
+  IndexedGrammar grammar(pcfg);
+
+  string path = "grammar.cmp";
+  size_t file_bytes[2];
+  CompactGrammar loaded;
+  for (LOG_PROB_PRECISION precision : {PRECISION_FLOAT, PRECISION_16BIT}) {
+    CompactGrammar(grammar, precision).Save(path);
+    ifstream file(path, ios::binary | ios::ate);
+    file_bytes[precision] = file.tellg();
+  }
+  // The 16-bit file is the one left on disk
+  if (!loaded.Load(path)) {
+    printf("could not load %s\n", path.c_str());
+    return;
+  }
+  remove(path.c_str());
+
+  printf("%-24s %12s\n", "representation", "bytes");
+  printf("%-24s %12zu\n", "PCFG", ApproximateMemoryBytes(pcfg));
+  printf("%-24s %12zu\n", "IndexedGrammar", ApproximateMemoryBytes(grammar));
+  printf("%-24s %12zu\n", "file float", file_bytes[PRECISION_FLOAT]);
+  printf("%-24s %12zu\n", "file 16 bit", file_bytes[PRECISION_16BIT]);
+
+  IndexedGrammar expanded = loaded.Expand();
+  DenseParser parser(grammar);
+  DenseParser quantized_parser(expanded);
+  int n_sentences = 0, n_same = 0;
+  double log_prob_diff = 0;
+  vector<shared_ptr<Tree<string> > > gold;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+    gold.push_back(t);
+    vector<string> tokens = GetTokens(t.get());
+    if (tokens.size() > 40) continue;
+    pTreeProb full = parser.Parse(tokens);
+    pTreeProb quantized = quantized_parser.Parse(tokens);
+    if (full.first == nullptr || quantized.first == nullptr) continue;
+    n_sentences++;
+    n_same += full.first->BracketString() == quantized.first->BracketString();
+    log_prob_diff += fabs(full.second - quantized.second);
+  }
+  printf("identical trees: %i/%i, mean |log prob diff|: %.5f\n", n_same,
+         n_sentences, log_prob_diff / max(n_sentences, 1));
+
+  EvaluationResult full_result = EvaluateParser(parser, gold, 40);
+  EvaluationResult quantized_result =
+      EvaluateParser(quantized_parser, gold, 40);
+  printf("tag acc float: %.4f (%.2f ms/sentence)\n", full_result.TagAccuracy(),
+         full_result.MillisecondsPerSentence());
+  printf("tag acc 16 bit: %.4f (%.2f ms/sentence)\n",
+         quantized_result.TagAccuracy(),
+         quantized_result.MillisecondsPerSentence());
+}
+
+// Trains the trigram tagger together with the PCFG on the first 90% of the
+// treebank and reports, on the last 10% (up to 40 tokens), the accuracy of
+// the tagger alone and speed and accuracy of the parser with the tagger
+// pre-pass for several posterior margins.
+void TaggerReport(vector<string> const& lines) {
+  int n_train = 0.9 * lines.size();
+  vector<shared_ptr<Tree<string> > > trees;
+  for (int i = 0; i < n_train; i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
     NormalizeTree(t.get());
-    //t->print();
-    //printf("%s",t->BracketString().c_str());
+    trees.push_back(t);
   }
-  printf("\nnumber of trees: %d\n",trees.size());
-  printf("InferePCFG\n");
+  TrigramTagger tagger;
+  PCFG pcfg = InferePCFG(trees, &tagger);
+  IndexedGrammar grammar(pcfg);
+  vector<shared_ptr<Tree<string> > > gold;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    gold.push_back(ParseTree(lines[i]));
+  }
+
+  // Viterbi tags with the lexicon scores of the grammar as emissions
+  // (the tagger's tags are the grammar's POS-tags, in the same order)
+  int n_sentences = 0, n_tokens = 0, n_correct = 0;
+  double tag_seconds = 0;
+  vector<float> emissions;
+  vector<int> tags;
+  for (shared_ptr<Tree<string> > const& t : gold) {
+    vector<string> tokens = GetTokens(t.get());
+    if (tokens.empty() || tokens.size() > 40) continue;
+    vector<string> gold_tags = GetPosTags(t.get());
+    auto start = chrono::steady_clock::now();
+    emissions.assign(tokens.size() * grammar.num_pos_tags(), -INFINITY);
+    for (size_t i = 0; i < tokens.size(); i++) {
+      int w = grammar.WordId(tokens[i]);
+      if (w < 0) continue;
+      for (int e = grammar.lexicon_offsets_[w];
+           e < grammar.lexicon_offsets_[w + 1]; e++) {
+        emissions[i * grammar.num_pos_tags() + grammar.lexicon_pos_[e]] =
+            grammar.lexicon_log_probs_[e];
+      }
+    }
+    tagger.Viterbi(emissions.data(), tokens.size(), tags);
+    tag_seconds += chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    n_sentences++;
+    n_tokens += tokens.size();
+    for (size_t i = 0; i < tags.size(); i++) {
+      n_correct += grammar.pos_tags_[tags[i]] == gold_tags[i];
+    }
+  }
+  printf("viterbi tagger: tag acc %.4f, %.3f ms/sentence\n",
+         (double)n_correct / max(n_tokens, 1), 1000 * tag_seconds / max(n_sentences, 1));
+
+  printf("%10s %12s %10s %10s %14s %10s\n", "margin", "ms/sentence",
+         "tag acc", "parsed", "pruned/token", "fallbacks");
+  vector<double> margins{0, 1e-4, 1e-3, 1e-2, 1e-1};
+  for (double margin : margins) {
+    DenseParser parser(grammar);
+    // margin 0: no pre-pass
+    if (margin > 0) parser.UseTagger(&tagger, margin);
+    EvaluationResult result = EvaluateParser(parser, gold, 40);
+    printf("%10g %12.2f %10.4f %5i/%-4i %14.2f %10i\n", margin,
+           result.MillisecondsPerSentence(), result.TagAccuracy(),
+           result.num_parsed_, result.num_sentences_,
+           (double)result.num_pruned_tags_ / max(result.num_tokens_, 1),
+           result.num_tag_fallbacks_);
+  }
+}
+
+// Sweeps the thresholds of ReduceGrammar: grammar size, parse throughput,
+// POS-tag accuracy and labeled bracket F1 on the last 10% of the treebank
+// (up to 40 tokens) for a grammar trained on the first 90% with the given
+// markovization. The operating point is chosen by bracket F1: the fastest
+// setting within kF1Tolerance of the best F1.
+void ReductionReport(vector<string> const& lines, int horizontal_order,
+                     int vertical_order) {
+  int n_train = 0.9 * lines.size();
+  RuleCounts counts;
+  for (int i = 0; i < n_train; i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+    NormalizeTree(t.get(), horizontal_order, vertical_order);
+    counts.AddTree(t.get());
+  }
+  vector<shared_ptr<Tree<string> > > gold;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    gold.push_back(ParseTree(lines[i]));
+  }
+
+  // (min count, min probability, backoff weight)
+  vector<tuple<double, double, double> > sweep{
+      {0, 0, 0},       {2, 0, 0},       {3, 0, 0},      {5, 0, 0},
+      {10, 0, 0},      {0, 1e-3, 0},    {0, 1e-2, 0},   {2, 1e-3, 0},
+      {0, 1e-3, 0.1},  {2, 1e-3, 0.1},  {2, 1e-2, 0.3}};
+  const double kF1Tolerance = 0.005;
+  printf("%6s %8s %7s %10s %10s %10s %12s %8s %10s %10s %10s\n", "count",
+         "prob", "backoff", "non terms", "bin rules", "un rules",
+         "ms/sentence", "sent/s", "tag acc", "bracket F1", "parsed");
+  vector<pair<double, double> > f1_and_ms;
+  for (auto const& config : sweep) {
+    ReductionOptions options;
+    options.min_count_ = get<0>(config);
+    options.min_probability_ = get<1>(config);
+    options.backoff_weight_ = get<2>(config);
+    RuleCounts reduced = counts;
+    ReduceGrammar(reduced, options);
+    PCFG pcfg = EstimatePCFG(reduced);
+    IndexedGrammar grammar(pcfg);
+    DenseParser parser(grammar);
+    EvaluationResult result = EvaluateParser(parser, gold, 40);
+    printf("%6g %8g %7g %10i %10i %10i %12.2f %8.1f %10.4f %10.4f %5i/%i\n",
+           options.min_count_, options.min_probability_,
+           options.backoff_weight_, grammar.num_non_terms(),
+           grammar.num_binary_rules(), grammar.num_unary_rules(),
+           result.MillisecondsPerSentence(),
+           1000 / max(result.MillisecondsPerSentence(), 1e-9),
+           result.TagAccuracy(), result.BracketF1(), result.num_parsed_,
+           result.num_sentences_);
+    f1_and_ms.push_back({result.BracketF1(), result.MillisecondsPerSentence()});
+  }
+
+  size_t best = 0;
+  for (size_t i = 1; i < f1_and_ms.size(); i++) {
+    if (f1_and_ms[i].first > f1_and_ms[best].first) best = i;
+  }
+  size_t chosen = best;
+  for (size_t i = 0; i < f1_and_ms.size(); i++) {
+    if (f1_and_ms[i].first >= f1_and_ms[best].first - kF1Tolerance &&
+        f1_and_ms[i].second < f1_and_ms[chosen].second) {
+      chosen = i;
+    }
+  }
+  printf("best bracket F1 %.4f: count %g, prob %g, backoff %g\n",
+         f1_and_ms[best].first, get<0>(sweep[best]), get<1>(sweep[best]),
+         get<2>(sweep[best]));
+  printf("fastest within %g F1: count %g, prob %g, backoff %g "
+         "(F1 %.4f, %.2f ms/sentence)\n",
+         kF1Tolerance, get<0>(sweep[chosen]), get<1>(sweep[chosen]),
+         get<2>(sweep[chosen]), f1_and_ms[chosen].first,
+         f1_and_ms[chosen].second);
+}
+
+// Parses the last 10% of the treebank (all lengths) as one batch: with the
+// sentences handed out in input order (one shared counter), with the
+// work-stealing BatchParser without and with splitting of long sentences.
+// Reports the batch times and checks that all give the same trees.
+void BatchReport(vector<string> const& lines, int n_threads) {
+  int n_train = 0.9 * lines.size();
+  vector<shared_ptr<Tree<string> > > trees;
+  for (int i = 0; i < n_train; i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+    NormalizeTree(t.get());
+    trees.push_back(t);
+  }
+  PCFG pcfg = InferePCFG(trees);
+  IndexedGrammar grammar(pcfg);
+  vector<vector<string> > sentences;
+  size_t max_length = 0;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    sentences.push_back(GetTokens(ParseTree(lines[i]).get()));
+    max_length = max(max_length, sentences.back().size());
+  }
+  printf("%zu sentences, up to %zu tokens, %i threads\n", sentences.size(),
+         max_length, n_threads);
+
+  auto start = chrono::steady_clock::now();
+  vector<pTreeProb> in_order(sentences.size());
+  atomic<size_t> next(0);
+  auto work = [&]() {
+    DenseParser parser(grammar);
+    for (size_t i = next++; i < sentences.size(); i = next++) {
+      in_order[i] = parser.Parse(sentences[i]);
+    }
+  };
+  vector<thread> threads;
+  for (int i = 1; i < n_threads; i++) threads.emplace_back(work);
+  work();
+  for (thread& t : threads) t.join();
+  double in_order_seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  printf("%-22s %8.3f s\n", "input order", in_order_seconds);
+
+  vector<pair<string, int> > configs{{"longest first", 0},
+                                     {"longest first + tiles", 30}};
+  for (auto const& config : configs) {
+    BatchOptions options;
+    options.threads_ = n_threads;
+    options.split_length_ = config.second;
+    BatchParser batch_parser(grammar, options);
+    vector<pTreeProb> results;
+    batch_parser.Parse(sentences, results);
+    int n_same = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+      if (results[i].first == nullptr || in_order[i].first == nullptr) {
+        n_same += results[i].first == in_order[i].first;
+        continue;
+      }
+      n_same += results[i].first->BracketString() ==
+                in_order[i].first->BracketString();
+    }
+    BatchStats const& stats = batch_parser.stats();
+    printf("%-22s %8.3f s, %i split, %li tasks, %li steals, "
+           "%i/%zu same trees\n", config.first.c_str(), stats.seconds_,
+           stats.split_sentences_, stats.tasks_, stats.steals_, n_same,
+           results.size());
+  }
+}
+
+// Parses the last 10% of the treebank twice, without cache, with the
+// sentence cache and with sentence and span cache, and reports the timings
+// and hit rates.
+void CacheReport(vector<string> const& lines) {
+  int n_train = 0.9 * lines.size();
+  vector<shared_ptr<Tree<string> > > trees;
+  for (int i = 0; i < n_train; i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+    NormalizeTree(t.get());
+    trees.push_back(t);
+  }
+  PCFG pcfg = InferePCFG(trees);
+  IndexedGrammar grammar(pcfg);
+  vector<vector<string> > sentences;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    vector<string> tokens = GetTokens(ParseTree(lines[i]).get());
+    if (tokens.size() <= 40) sentences.push_back(tokens);
+  }
+
+  vector<pair<string, shared_ptr<ParseCache> > > configs{
+      {"no cache", nullptr},
+      {"sentences", make_shared<ParseCache>(64 << 20)},
+      {"sentences+spans", make_shared<ParseCache>(64 << 20, 64 << 20, 8)}};
+  printf("%-16s %10s %10s %10s %10s %10s\n", "cache", "pass 1 s", "pass 2 s",
+         "sent hits", "span hits", "span MB");
+  for (auto const& config : configs) {
+    DenseParser parser(grammar);
+    parser.UseCache(config.second.get());
+    double seconds[2];
+    for (int pass = 0; pass < 2; pass++) {
+      auto start = chrono::steady_clock::now();
+      for (vector<string> const& tokens : sentences) {
+        parser.Parse(tokens);
+      }
+      seconds[pass] = chrono::duration<double>(
+          chrono::steady_clock::now() - start).count();
+    }
+    CacheStats sentence_stats, span_stats;
+    if (config.second != nullptr) {
+      sentence_stats = config.second->SentenceStats();
+      span_stats = config.second->SpanStats();
+    }
+    printf("%-16s %10.3f %10.3f %10.3f %10.3f %10.2f\n", config.first.c_str(),
+           seconds[0], seconds[1], sentence_stats.HitRate(),
+           span_stats.HitRate(), span_stats.bytes_ / 1e6);
+  }
+}
 
+// Applies random edits (insert, delete or replace a word) to the held-out
+// sentences in a ParseSession and compares every incremental re-parse with
+// a full parse of the edited sentence: trees, log probabilities and time.
+void SessionReport(vector<string> const& lines, int edits_per_sentence) {
+  int n_train = 0.9 * lines.size();
+  vector<shared_ptr<Tree<string> > > trees;
+  for (int i = 0; i < n_train; i++) {
+    shared_ptr<Tree<string> > t = ParseTree(lines[i]);
+    NormalizeTree(t.get());
+    trees.push_back(t);
+  }
   PCFG pcfg = InferePCFG(trees);
+  IndexedGrammar grammar(pcfg);
+  vector<vector<string> > sentences;
+  vector<string> words;
+  for (size_t i = n_train; i < lines.size(); i++) {
+    vector<string> tokens = GetTokens(ParseTree(lines[i]).get());
+    if (tokens.size() > 40) continue;
+    sentences.push_back(tokens);
+    words.insert(words.end(), tokens.begin(), tokens.end());
+  }
+
+  ParseSession session(grammar);
+  DenseParser parser(grammar);
+  std::mt19937 random(1);
+  int n_edits = 0, n_same = 0;
+  double session_seconds = 0, full_seconds = 0;
+  for (vector<string> const& tokens : sentences) {
+    session.SetTokens(tokens);
+    for (int e = 0; e < edits_per_sentence; e++) {
+      string const& word = words[random() % words.size()];
+      int edit = session.size() > 1 ? random() % 3 : 0;
+      int position = random() % (session.size() + (edit == 0 ? 1 : 0));
+      auto start = chrono::steady_clock::now();
+      pTreeProb incremental;
+      if (edit == 0) {
+        incremental = session.Insert(position, word);
+      } else if (edit == 1) {
+        incremental = session.Delete(position);
+      } else {
+        incremental = session.Replace(position, word);
+      }
+      auto middle = chrono::steady_clock::now();
+      pTreeProb full = parser.Parse(session.tokens());
+      auto end = chrono::steady_clock::now();
+      session_seconds += chrono::duration<double>(middle - start).count();
+      full_seconds += chrono::duration<double>(end - middle).count();
+
+      n_edits++;
+      if (incremental.first == nullptr || full.first == nullptr) {
+        n_same += incremental.first == full.first;
+      } else {
+        n_same += incremental.second == full.second &&
+                  incremental.first->BracketString() ==
+                      full.first->BracketString();
+      }
+    }
+  }
+  printf("identical to full parse: %i/%i edits\n", n_same, n_edits);
+  printf("ms/edit incremental: %.2f, full: %.2f\n",
+         1000 * session_seconds / max(n_edits, 1),
+         1000 * full_seconds / max(n_edits, 1));
+}
+
+int main(int argc, char** argv) {
+  ifstream infile("../data/sequoia-corpus+fct.mrg_strict");
+  string line;
+
+  // ./main markov-report
+  if (argc >= 2 && string(argv[1]) == "markov-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    MarkovReport(lines);
+    return 0;
+  }
+
+  // ./main compact-report
+  if (argc >= 2 && string(argv[1]) == "compact-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    CompactReport(lines);
+    return 0;
+  }
+
+  // ./main cache-report
+  if (argc >= 2 && string(argv[1]) == "cache-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    CacheReport(lines);
+    return 0;
+  }
+
+  // ./main session-report [edits per sentence]
+  if (argc >= 2 && string(argv[1]) == "session-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    SessionReport(lines, argc >= 3 ? stoi(argv[2]) : 2);
+    return 0;
+  }
+
+  // ./main reduction-report [horizontal order] [vertical order]
+  if (argc >= 2 && string(argv[1]) == "reduction-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    ReductionReport(lines, argc >= 3 ? stoi(argv[2]) : -1,
+                    argc >= 4 ? stoi(argv[3]) : 1);
+    return 0;
+  }
+
+  // ./main batch-report [threads]
+  if (argc >= 2 && string(argv[1]) == "batch-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    BatchReport(lines, argc >= 3 ? stoi(argv[2])
+                                 : (int)thread::hardware_concurrency());
+    return 0;
+  }
+
+  // ./main tagger-report
+  if (argc >= 2 && string(argv[1]) == "tagger-report") {
+    vector<string> lines;
+    while (getline(infile, line)) {
+      lines.push_back(line);
+    }
+    TaggerReport(lines);
+    return 0;
+  }
+
+  // ./main train <treebank file> <grammar file> [horizontal] [vertical]
+  // Streaming training on a treebank of any size, one tree per line.
+  // Saves the grammar as CompactGrammar (16 bit log probabilities).
+  if (argc >= 4 && string(argv[1]) == "train") {
+    ifstream treebank(argv[2]);
+    RuleCounts counts;
+    long n_trees = CountTreebank(treebank, counts,
+                                 argc >= 5 ? stoi(argv[4]) : -1,
+                                 argc >= 6 ? stoi(argv[5]) : 1);
+    printf("%li trees, %zu distinct grammar rules, %zu distinct lexicon "
+           "rules\n", n_trees, counts.grammar_counts_.size(),
+           counts.lexicon_counts_.size());
+    IndexedGrammar grammar(EstimatePCFG(counts));
+    CompactGrammar compact(grammar, PRECISION_16BIT);
+    if (!compact.Save(argv[3])) {
+      printf("could not write %s\n", argv[3]);
+      return 1;
+    }
+    printf("saved %s\n", argv[3]);
+    return 0;
+  }
+
+  // The trees are counted as they are read, only the counts are kept
+  RuleCounts counts;
+  long n_trees = CountTreebank(infile, counts);
+  printf("\nnumber of trees: %li\n", n_trees);
+  printf("InferePCFG\n");
+
+  PCFG pcfg = EstimatePCFG(counts);
   printf("# vocab: %d\n", pcfg.lexicon_.size());
   printf("# non terms: %d\n", pcfg.non_terminals_.size());
   printf("# pos tags: %d\n", pcfg.pos_tags_.size());
 
+  // ./main em <raw text file> [iterations] [threads]
+  // Re-estimates the treebank PCFG with EM on raw text, one space separated
+  // sentence per line
+  if (argc >= 3 && string(argv[1]) == "em") {
+    ifstream raw_file(argv[2]);
+    vector<vector<string> > sentences;
+    while (getline(raw_file, line)) {
+      sentences.push_back(split(line, ' '));
+    }
+    int iterations = argc >= 4 ? stoi(argv[3]) : 3;
+    int threads = argc >= 5 ? stoi(argv[4]) : thread::hardware_concurrency();
+    PCFG em_pcfg = TrainEM(pcfg, sentences, iterations, threads);
+    printf("# rules after EM: %zu\n", em_pcfg.grammar_probs_.size());
+    return 0;
+  }
+
+
+  Tokenizer tokenizer(pcfg.lexicon_);
+  vector<string_view> views;
+
+  // ./main parse-text <raw text file> [max milliseconds per sentence]
+  // Tokenizes and parses one sentence per line, prints the trees in the
+  // treebank format
+  if (argc >= 3 && string(argv[1]) == "parse-text") {
+    IndexedGrammar grammar(pcfg);
+    DenseParser parser(grammar);
+    if (argc >= 4) parser.SetBudget(stod(argv[3]) / 1000, 0);
+    ifstream raw_file(argv[2]);
+    for (int i = 1; getline(raw_file, line); i++) {
+      tokenizer.Tokenize(line, views);
+      pTreeProb parse = parser.Parse(views);
+      if (parser.partial()) {
+        fprintf(stderr, "line %i: partial parse\n", i);
+      }
+      if (parse.first == nullptr) {
+        cout << "(())" << endl;
+        continue;
+      }
+      cout << "( (";
+      WriteBracketString(parse.first.get(), cout, true);
+      cout << "))" << endl;
+    }
+    return 0;
+  }
+
+  // ./main pipeline <raw text file> [tokenize] [correct] [parse] [serialize]
+  // Splits, tokenizes, corrects and parses documents (one per line) with
+  // the given number of threads per stage (default 1), prints the trees in
+  // the treebank format and the utilization of every stage on stderr
+  if (argc >= 3 && string(argv[1]) == "pipeline") {
+    IndexedGrammar grammar(pcfg);
+    PipelineOptions options;
+    if (argc >= 4) options.tokenize_threads_ = stoi(argv[3]);
+    if (argc >= 5) options.correct_threads_ = stoi(argv[4]);
+    if (argc >= 6) options.parse_threads_ = stoi(argv[5]);
+    if (argc >= 7) options.serialize_threads_ = stoi(argv[6]);
+    DocumentPipeline pipeline(grammar, tokenizer, options);
+    ifstream raw_file(argv[2]);
+    PipelineResult result = pipeline.Run(raw_file, cout);
+    fprintf(stderr, "%li documents, %li sentences (%li partial, %li failed) "
+            "in %.2fs\n", result.num_documents_, result.num_sentences_,
+            result.num_partial_, result.num_failed_, result.seconds_);
+    fprintf(stderr, "%-10s %7s %7s %9s %9s %9s %7s\n", "stage", "threads",
+            "items", "busy s", "idle s", "blocked s", "util");
+    for (StageStats const& stage : result.stages_) {
+      fprintf(stderr, "%-10s %7i %7li %9.3f %9.3f %9.3f %6.1f%%\n",
+              stage.name_.c_str(), stage.threads_, stage.items_,
+              stage.busy_seconds_, stage.idle_seconds_,
+              stage.blocked_seconds_, 100 * stage.Utilization());
+    }
+    return 0;
+  }
 
   // Read a new sentence from command line
-  line = "Cette exposition nous apprend que une industrie métallurgique existait .";
-  vector<string> tokens = split(line, ' ');
+  line = "Cette exposition nous apprend qu'une industrie métallurgique existait.";
+  tokenizer.Tokenize(line, views);
+  vector<string> tokens(views.begin(), views.end());
 
   shared_ptr<Tree<string> > t = pcfg.ParseSentence(tokens);
-  //DenormalizeTree(&t);
+
+  // The 5 most likely trees, e.g. for reranking
+  vector<pTreeProb> kbest = pcfg.ParseSentenceKBest(tokens, 5);
+  for (pTreeProb const& ptb : kbest) {
+    printf("%.4f %s\n", ptb.second, ptb.first->BracketString().c_str());
+  }
+
+  // Same sentence on the dense chart
+  IndexedGrammar grammar(pcfg);
+  DenseParser dense_parser(grammar);
+  pTreeProb dense = dense_parser.Parse(tokens);
+  if (dense.first != nullptr) {
+    printf("dense (kernel %i): %.4f %s\n", dense_parser.kernel(), dense.second,
+           dense.first->BracketString().c_str());
+  }
+
+  // Output in the treebank format, without the normalization dummies
+  if (dense.first != nullptr) {
+    cout << "( (";
+    WriteBracketString(dense.first.get(), cout, true);
+    cout << "))" << endl;
+  }
 }
@@ -0,0 +1,94 @@
+#include "oov.h"
+
+#include <algorithm>
+
+static const int kMaxDistance = 2;
+
+static uint64_t CharacterMask(string_view word) {
+  uint64_t mask = 0;
+  for (char c : word) mask |= uint64_t(1) << ((unsigned char)c & 63);
+  return mask;
+}
+
+int DamerauLevenshtein(string_view a, string_view b) {
+  size_t n = a.size();
+  size_t m = b.size();
+  // Three rows of the (n+1) x (m+1) distance matrix
+  vector<int> before(m + 1), previous(m + 1), current(m + 1);
+  for (size_t j = 0; j <= m; j++) previous[j] = j;
+  for (size_t i = 1; i <= n; i++) {
+    current[0] = i;
+    for (size_t j = 1; j <= m; j++) {
+      int substitution = a[i - 1] == b[j - 1] ? 0 : 1;
+      int d = std::min({previous[j] + 1,        // deletion
+                        current[j - 1] + 1,     // insertion
+                        previous[j - 1] + substitution});
+      if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1]) {
+        d = std::min(d, before[j - 2] + 1);  // transposition
+      }
+      current[j] = d;
+    }
+    std::swap(before, previous);
+    std::swap(previous, current);
+  }
+  return previous[m];
+}
+
+OovCorrector::OovCorrector(IndexedGrammar const& grammar, int max_candidates)
+    : grammar_(grammar), max_candidates_(max_candidates) {
+  for (string const& word : grammar.words_) {
+    // Signatures and <UNK> are no corrections
+    if (word.compare(0, 4, "<UNK") == 0) continue;
+    if (word.size() >= words_by_length_.size()) {
+      words_by_length_.resize(word.size() + 1);
+      masks_by_length_.resize(word.size() + 1);
+    }
+    words_by_length_[word.size()].push_back(word);
+    masks_by_length_[word.size()].push_back(CharacterMask(word));
+  }
+}
+
+vector<pair<string_view, int> > OovCorrector::CloseWords(
+    string_view word) const {
+  vector<pair<string_view, int> > close;
+  uint64_t mask = CharacterMask(word);
+  size_t min_length = word.size() > kMaxDistance ? word.size() - kMaxDistance
+                                                 : 0;
+  size_t max_length = std::min(word.size() + kMaxDistance + 1,
+                               words_by_length_.size());
+  for (size_t length = min_length; length < max_length; length++) {
+    vector<string_view> const& words = words_by_length_[length];
+    vector<uint64_t> const& masks = masks_by_length_[length];
+    for (size_t i = 0; i < words.size(); i++) {
+      // Every differing mask bit is a character that needs an edit,
+      // two edits change at most 4 characters
+      if (__builtin_popcountll(mask ^ masks[i]) > 2 * kMaxDistance) continue;
+      int distance = DamerauLevenshtein(word, words[i]);
+      if (distance <= kMaxDistance) close.push_back({words[i], distance});
+    }
+  }
+  std::sort(close.begin(), close.end(),
+            [](pair<string_view, int> const& a,
+               pair<string_view, int> const& b) {
+              return a.second != b.second ? a.second < b.second
+                                          : a.first < b.first;
+            });
+  return close;
+}
+
+void OovCorrector::Correct(
+    vector<string_view> const& tokens,
+    vector<vector<pair<string, double> > >& lattice) const {
+  lattice.resize(tokens.size());
+  for (size_t i = 0; i < tokens.size(); i++) {
+    vector<pair<string, double> >& candidates = lattice[i];
+    candidates.clear();
+    candidates.push_back({string(tokens[i]), 0});
+    if (grammar_.word_hash_.Find(tokens[i]) >= 0) continue;
+    for (pair<string_view, int> const& close : CloseWords(tokens[i])) {
+      if ((int)candidates.size() > max_candidates_) break;
+      candidates.push_back({string(close.first),
+                            close.second * kEditLogPenalty});
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef OOV_H
+#define OOV_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "indexed_grammar.h"
+
+using std::pair;
+using std::string;
+using std::string_view;
+using std::vector;
+
+// Damerau-Levenshtein distance a.k.a. optimal string alignment distance
+// (insertions, deletions, substitutions and transpositions of neighbouring
+// characters) on bytes
+int DamerauLevenshtein(string_view a, string_view b);
+
+// Typo handling for the words a grammar does not know, the C++ version of
+// the Levenshtein part of code/oov.py.
+// A known word is kept as it is. An unknown word becomes a lattice position
+// with the word itself (parsed through its signature, see WordSignature)
+// and the lexicon words within a distance of 2, each penalized by
+// kEditLogPenalty per edit. Most lexicon words are ruled out by their
+// length and a character mask before any distance is computed.
+// Correct is const and can be called from several threads at once.
+class OovCorrector {
+ public:
+  // Log weight of a single edit
+  static constexpr double kEditLogPenalty = -2.302585;  // log(0.1)
+
+  // Unknown words get at most max_candidates corrections
+  OovCorrector(IndexedGrammar const& grammar, int max_candidates = 8);
+
+  // Candidates for every token, for DenseParser::Parse(lattice)
+  void Correct(vector<string_view> const& tokens,
+               vector<vector<pair<string, double> > >& lattice) const;
+  // Lexicon words within distance 2 of word, closest first
+  vector<pair<string_view, int> > CloseWords(string_view word) const;
+
+ private:
+  IndexedGrammar const& grammar_;
+  int max_candidates_;
+  // Words of the lexicon (no signatures) by length in bytes
+  vector<vector<string_view> > words_by_length_;
+  // Characters of each word as a 64 bit mask, parallel to words_by_length_
+  vector<vector<uint64_t> > masks_by_length_;
+};
+
+#endif
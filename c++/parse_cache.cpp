@@ -0,0 +1,58 @@
+#include "parse_cache.h"
+
+static string SentenceKey(vector<string_view> const& tokens) {
+  string key;
+  for (string_view token : tokens) {
+    key.append(token.data(), token.size());
+    key.push_back('\x1f');
+  }
+  return key;
+}
+
+static string SpanKey(int const* word_ids, int length) {
+  return string((char const*)word_ids, length * sizeof(int));
+}
+
+// Rough heap size of a tree
+static size_t TreeBytes(Tree<string>* t) {
+  size_t bytes = 0;
+  vector<Tree<string>*> stack{t};
+  while (!stack.empty()) {
+    Tree<string>* node = stack.back();
+    stack.pop_back();
+    // Node, shared_ptr control block and the child pointer
+    bytes += sizeof(Tree<string>) + 32 + node->value_.capacity();
+    for (auto const& child : node->children_) {
+      stack.push_back(child.get());
+    }
+  }
+  return bytes;
+}
+
+ParseCache::ParseCache(size_t max_sentence_bytes, size_t max_span_bytes,
+                       int max_span_length)
+    : sentences_(max_sentence_bytes),
+      spans_(max_span_bytes, true),
+      max_span_length_(max_span_bytes > 0 ? max_span_length : 0) { ; }
+
+bool ParseCache::GetSentence(vector<string_view> const& tokens,
+                             pTreeProb& result) {
+  return sentences_.Get(SentenceKey(tokens), result);
+}
+
+void ParseCache::PutSentence(vector<string_view> const& tokens,
+                             pTreeProb const& result) {
+  size_t bytes = result.first != nullptr ? TreeBytes(result.first.get()) : 0;
+  sentences_.Put(SentenceKey(tokens), result, bytes);
+}
+
+bool ParseCache::GetSpan(int const* word_ids, int length, SpanScores& scores,
+                         bool& admit) {
+  return spans_.Get(SpanKey(word_ids, length), scores, &admit);
+}
+
+void ParseCache::PutSpan(int const* word_ids, int length,
+                         SpanScores const& scores) {
+  spans_.Put(SpanKey(word_ids, length), scores,
+             scores->capacity() * sizeof(pair<int, float>));
+}
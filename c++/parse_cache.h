@@ -0,0 +1,193 @@
+#ifndef PARSE_CACHE_H
+#define PARSE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tree.h"
+
+using std::list;
+using std::mutex;
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+struct CacheStats {
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  size_t insertions_ = 0;
+  size_t evictions_ = 0;
+  size_t entries_ = 0;
+  size_t bytes_ = 0;
+
+  double HitRate() const {
+    return hits_ + misses_ > 0 ? (double)hits_ / (hits_ + misses_) : 0;
+  }
+};
+
+// Least recently used cache from string keys to values of type V, bounded
+// by a total number of bytes (as given by the caller on Put).
+// The keys are spread over shards with a mutex each, so threads working on
+// different keys rarely wait for each other.
+// With admit_on_second_miss, Get tells on a miss whether the key was missed
+// before (within a while). Callers only Put such keys, which keeps one-off
+// keys from evicting frequent ones and saves building their values.
+template <typename V>
+class LruCache {
+ public:
+  LruCache(size_t max_bytes, bool admit_on_second_miss = false,
+           int n_shards = 16)
+      : shards_(n_shards),
+        max_shard_bytes_(max_bytes / n_shards),
+        admit_on_second_miss_(admit_on_second_miss) { ; }
+
+  // Copies the value of key to value and marks it as recently used.
+  // Returns false if the key is not cached; admit is then set to whether the
+  // key should be put (always true without admit_on_second_miss).
+  bool Get(string const& key, V& value, bool* admit = nullptr);
+  void Put(string const& key, V const& value, size_t bytes);
+  CacheStats Stats() const;
+
+ private:
+  struct Entry {
+    string key_;
+    V value_;
+    size_t bytes_;
+  };
+  struct Shard {
+    mutable mutex mutex_;
+    // Most recently used first
+    list<Entry> entries_;
+    unordered_map<string_view, typename list<Entry>::iterator> index_;
+    // Hashes of keys that were missed once but not admitted yet
+    unordered_set<size_t> seen_once_;
+    CacheStats stats_;
+  };
+
+  vector<Shard> shards_;
+  size_t max_shard_bytes_;
+  bool admit_on_second_miss_;
+
+  Shard& ShardOf(size_t hash) { return shards_[hash % shards_.size()]; }
+};
+
+template <typename V>
+bool LruCache<V>::Get(string const& key, V& value, bool* admit) {
+  size_t hash = std::hash<string>()(key);
+  Shard& shard = ShardOf(hash);
+  std::lock_guard<mutex> lock(shard.mutex_);
+  auto it = shard.index_.find(key);
+  if (it == shard.index_.end()) {
+    shard.stats_.misses_++;
+    if (admit == nullptr) return false;
+    *admit = true;
+    if (admit_on_second_miss_) {
+      *admit = shard.seen_once_.erase(hash) > 0;
+      if (!*admit) {
+        // Forget old candidates now and then, the set stays small
+        if (shard.seen_once_.size() > 4 * (shard.entries_.size() + 1024)) {
+          shard.seen_once_.clear();
+        }
+        shard.seen_once_.insert(hash);
+      }
+    }
+    return false;
+  }
+  shard.stats_.hits_++;
+  shard.entries_.splice(shard.entries_.begin(), shard.entries_, it->second);
+  value = it->second->value_;
+  return true;
+}
+
+template <typename V>
+void LruCache<V>::Put(string const& key, V const& value, size_t bytes) {
+  size_t hash = std::hash<string>()(key);
+  Shard& shard = ShardOf(hash);
+  bytes += sizeof(Entry) + 2 * key.size();
+  if (bytes > max_shard_bytes_) return;
+  std::lock_guard<mutex> lock(shard.mutex_);
+  if (shard.index_.count(key)) return;
+  while (shard.stats_.bytes_ + bytes > max_shard_bytes_) {
+    Entry& last = shard.entries_.back();
+    shard.stats_.bytes_ -= last.bytes_;
+    shard.stats_.evictions_++;
+    shard.stats_.entries_--;
+    shard.index_.erase(last.key_);
+    shard.entries_.pop_back();
+  }
+  shard.entries_.push_front(Entry{key, value, bytes});
+  // The index refers to the key stored in the entry
+  shard.index_[shard.entries_.front().key_] = shard.entries_.begin();
+  shard.stats_.bytes_ += bytes;
+  shard.stats_.entries_++;
+  shard.stats_.insertions_++;
+}
+
+template <typename V>
+CacheStats LruCache<V>::Stats() const {
+  CacheStats total;
+  for (Shard const& shard : shards_) {
+    std::lock_guard<mutex> lock(shard.mutex_);
+    total.hits_ += shard.stats_.hits_;
+    total.misses_ += shard.stats_.misses_;
+    total.insertions_ += shard.stats_.insertions_;
+    total.evictions_ += shard.stats_.evictions_;
+    total.entries_ += shard.stats_.entries_;
+    total.bytes_ += shard.stats_.bytes_;
+  }
+  return total;
+}
+
+// Scores of a chart cell that are not -inf, as (NonTerm id, log probability)
+typedef std::shared_ptr<const vector<pair<int, float> > > SpanScores;
+
+// Cache of parse results, shared by the DenseParsers of all worker threads
+// (see DenseParser::UseCache). All parsers using one cache must run on the
+// same grammar.
+// - Sentences: the token sequence maps to the finished tree and its log
+//   probability. Cached trees are shared, so callers must not modify them
+//   (WriteBracketString can denormalize without modification).
+// - Spans (optional): the word ids of a span of at most max_span_length
+//   tokens map to the scores of its chart cell. In a PCFG those only depend
+//   on the words of the span, not on the rest of the sentence. Only the
+//   finite scores are stored. Spans are admitted on their second miss.
+class ParseCache {
+ public:
+  // max_span_bytes = 0 disables the span cache
+  ParseCache(size_t max_sentence_bytes, size_t max_span_bytes = 0,
+             int max_span_length = 8);
+
+  bool GetSentence(vector<string_view> const& tokens, pTreeProb& result);
+  void PutSentence(vector<string_view> const& tokens, pTreeProb const& result);
+
+  bool span_cache_enabled() const { return max_span_length_ > 0; }
+  int max_span_length() const { return max_span_length_; }
+  // word_ids are the ids of the span's tokens. On a miss, admit tells
+  // whether the span should be put.
+  bool GetSpan(int const* word_ids, int length, SpanScores& scores,
+               bool& admit);
+  void PutSpan(int const* word_ids, int length,
+               SpanScores const& scores);
+
+  CacheStats SentenceStats() const { return sentences_.Stats(); }
+  CacheStats SpanStats() const { return spans_.Stats(); }
+
+ private:
+  LruCache<pTreeProb> sentences_;
+  LruCache<SpanScores> spans_;
+  int max_span_length_;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "parse_session.h"
+
+#include <cmath>
+
+ParseSession::ParseSession(IndexedGrammar const& grammar, KERNEL_TYPE kernel)
+    : parser_(grammar, kernel) { ; }
+
+pTreeProb ParseSession::SetTokens(vector<string> const& tokens) {
+  tokens_ = tokens;
+  return parser_.Parse(tokens_);
+}
+
+pTreeProb ParseSession::Insert(int position, string const& token) {
+  if (position < 0 || position > size()) return pTreeProb(nullptr, -INFINITY);
+  tokens_.insert(tokens_.begin() + position, token);
+  return Reparse(position, 0, 1);
+}
+
+pTreeProb ParseSession::Delete(int position) {
+  if (position < 0 || position >= size()) return pTreeProb(nullptr, -INFINITY);
+  tokens_.erase(tokens_.begin() + position);
+  return Reparse(position, 1, 0);
+}
+
+pTreeProb ParseSession::Replace(int position, string const& token) {
+  if (position < 0 || position >= size()) return pTreeProb(nullptr, -INFINITY);
+  tokens_[position] = token;
+  return Reparse(position, 1, 1);
+}
+
+pTreeProb ParseSession::Reparse(int position, int n_removed, int n_inserted) {
+  // The parser keeps views of the tokens, which may have moved
+  vector<string_view> views(tokens_.begin(), tokens_.end());
+  return parser_.Reparse(views, position, n_removed, n_inserted);
+}
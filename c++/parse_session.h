@@ -0,0 +1,49 @@
+#ifndef PARSE_SESSION_H
+#define PARSE_SESSION_H
+
+#include <string>
+#include <vector>
+
+#include "dense_parser.h"
+#include "indexed_grammar.h"
+#include "tree.h"
+
+using std::string;
+using std::vector;
+
+// A sentence that is edited one token at a time (e.g. in an editor), with
+// the parse kept up to date. The chart is kept between edits and only the
+// spans containing the edited position are recomputed: for an edit at
+// position p of an n token sentence these are about p * (n - p) spans
+// instead of n^2 / 2 (see DenseParser::Reparse).
+//
+// Every edit returns the new best tree and its log probability, like
+// DenseParser::Parse. An edit at a position out of range leaves the
+// session unchanged and returns (nullptr, -inf).
+class ParseSession {
+ public:
+  ParseSession(IndexedGrammar const& grammar,
+               KERNEL_TYPE kernel = KERNEL_AUTO);
+
+  // Starts over with new tokens (full parse)
+  pTreeProb SetTokens(vector<string> const& tokens);
+  // Inserts token before position, 0 <= position <= size()
+  // (position = size() appends)
+  pTreeProb Insert(int position, string const& token);
+  // 0 <= position < size()
+  pTreeProb Delete(int position);
+  pTreeProb Replace(int position, string const& token);
+
+  vector<string> const& tokens() const { return tokens_; }
+  int size() const { return tokens_.size(); }
+  // The parser, e.g. for SetBudget or partial()
+  DenseParser& parser() { return parser_; }
+
+ private:
+  DenseParser parser_;
+  vector<string> tokens_;
+
+  pTreeProb Reparse(int position, int n_removed, int n_inserted);
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "pcfg.h"
 #include "tree.h"
+#include "kbest.h"
+#include "pos_tagger.h"
+#include "utils.h"
+
+#include <cmath>
 
 
 Rule::Rule(string left, string right) {
@@ -45,16 +50,23 @@ PCFG::PCFG(set<string>& non_terminals, set<string>& pos_tags,
 
   // Construct the reverse lexicon
   // Which POS-tags can each word be produced from, and with which probabilitiy?
-  for (string word : lexicon_) {
-    reverse_lexicon_[word] = vector<pair<string, double> >();
-  }
+  map<Token, vector<pair<PosTag, double> > > reverse_lexicon;
   for (auto const& it : lexicon_probs_) {
     string pos_tag = it.first.left_;
     string word = it.first.right_[0];
     double probability = it.second;
-    reverse_lexicon_[word].push_back(
+    reverse_lexicon[word].push_back(
         pair<string, double>(pos_tag, probability));
   }
+  vector<string> words;
+  for (auto const& it : reverse_lexicon) {
+    words.push_back(it.first);
+  }
+  lexicon_hash_ = PerfectHash(words);
+  lexicon_pos_tags_.resize(words.size());
+  for (auto& it : reverse_lexicon) {
+    lexicon_pos_tags_[lexicon_hash_.Find(it.first)].swap(it.second);
+  }
 
   // Construct the reverse grammar
   // From which NonTerminals can other NonTerminals or POS-Tags be generated 
@@ -67,23 +79,12 @@ PCFG::PCFG(set<string>& non_terminals, set<string>& pos_tags,
     if (is_binary_rule) {
       Rule const& rule = it.first;
       auto generated = pair<string, string>(rule.right_[0], rule.right_[1]);
-      NonTerm generated_left = rule.right_[0];
-      NonTerm generated_right = rule.right_[1];
       double probability = it.second;
       pair<Rule, double> entry(rule, probability);
 
       if (reverse_grammar_binary_.count(generated) == 0) {
         reverse_grammar_binary_[generated] = vector<pair<Rule, double> >();
       }
-      if (generate_left.count(generated_left) == 0) {
-        generate_left[generated_left] = vector<pair<Rule, double> >();
-      }
-      if (generate_right.count(generated_right) == 0) {
-        generate_right[generated_right] = vector<pair<Rule, double> >();
-      }
-      
-      generate_right[generated_right].push_back(entry);
-      generate_left[generated_left].push_back(entry);
       reverse_grammar_binary_[generated].push_back(entry);
     } else if (is_single_rule) {
       double probability = it.second;
@@ -96,19 +97,54 @@ PCFG::PCFG(set<string>& non_terminals, set<string>& pos_tags,
       reverse_grammar_single_[pos_tag].push_back(entry);
     }
   }
+
+  // Number the NonTerms for the bitset filters
+  for (string const& nt : non_terminals_) {
+    non_term_ids_.insert(pair<NonTerm, int>(nt, non_term_ids_.size()));
+  }
+  for (auto const& it : reverse_grammar_binary_) {
+    non_term_ids_.insert(pair<NonTerm, int>(it.first.first,
+                                            non_term_ids_.size()));
+    non_term_ids_.insert(pair<NonTerm, int>(it.first.second,
+                                            non_term_ids_.size()));
+  }
+  int n_ids = non_term_ids_.size();
+  left_children_ = SymbolSet(n_ids);
+  right_children_ = SymbolSet(n_ids);
+  right_children_of_ = vector<SymbolSet>(n_ids, SymbolSet(n_ids));
+  for (auto const& it : reverse_grammar_binary_) {
+    int left_id = non_term_ids_[it.first.first];
+    int right_id = non_term_ids_[it.first.second];
+    left_children_.Insert(left_id);
+    right_children_.Insert(right_id);
+    right_children_of_[left_id].Insert(right_id);
+  }
 }
 
-vector<pair<Rule, double> > PCFG::GetGeneratingNonTerms(string left_nt,
-                                                          string right_nt) {
-  return reverse_grammar_binary_[pair<string,string>(left_nt, right_nt)];
+static vector<pair<Rule, double> > const kNoRules;
+static vector<pair<string, double> > const kNoSymbols;
+
+vector<pair<Rule, double> > const& PCFG::GetGeneratingNonTerms(
+    string const& left_nt, string const& right_nt) const {
+  auto it = reverse_grammar_binary_.find(pair<string, string>(left_nt, right_nt));
+  if (it == reverse_grammar_binary_.end()) return kNoRules;
+  return it->second;
 }
 
-vector<pair<string, double> > PCFG::GetGeneratingNonTerms(string pos_tag) {
-  return reverse_grammar_single_[pos_tag];
+vector<pair<string, double> > const& PCFG::GetGeneratingNonTerms(
+    string const& pos_tag) const {
+  auto it = reverse_grammar_single_.find(pos_tag);
+  if (it == reverse_grammar_single_.end()) return kNoSymbols;
+  return it->second;
 }
 
-vector<pair<string, double> > PCFG::GetGeneratingPosTags(string word) {
-  return reverse_lexicon_[word];
+vector<pair<string, double> > const& PCFG::GetGeneratingPosTags(
+    string const& word) const {
+  int slot = lexicon_hash_.Find(word);
+  if (slot < 0) slot = lexicon_hash_.Find(WordSignature(word));
+  if (slot < 0) slot = lexicon_hash_.Find("<UNK>");
+  if (slot < 0) return kNoSymbols;
+  return lexicon_pos_tags_[slot];
 }
 
 void print (pTreeProb pTP) {
@@ -126,7 +162,7 @@ void printRow(ParseTableRow& row) {
   }
 }
 
-ParseTableRow PCFG::BuildTokenRow(vector<string> const & tokens) {
+ParseTableRow PCFG::BuildTokenRow(vector<string> const & tokens) const {
   ParseTableRow row;
   // Lowest row simply contains the tokens wraped in a tree
   for (int i = 0; i < tokens.size(); i++) {
@@ -139,7 +175,7 @@ ParseTableRow PCFG::BuildTokenRow(vector<string> const & tokens) {
 
 ParseTableRow PCFG::BuildUnitaryParentRow(
                               ParseTableRow const & children_row,
-                              SYMBOL_TYPE children_type){
+                              SYMBOL_TYPE children_type) const {
 
   ParseTableRow parents_row;
   for (vector<pTreeProb> const & children_cell : children_row) {
@@ -149,15 +185,15 @@ ParseTableRow PCFG::BuildUnitaryParentRow(
 
       shared_ptr<Tree<string> > child_tree = child_and_prob.first;
       string child_symbol = child_tree->value_;
-      vector<pair<string,double> > parent_symbols;
+      vector<pair<string,double> > const* parent_symbols = &kNoSymbols;
       
       if (children_type==POS_TAG) {
-        parent_symbols = GetGeneratingNonTerms(child_symbol);
+        parent_symbols = &GetGeneratingNonTerms(child_symbol);
       } else if (children_type==TOKEN) {
-        parent_symbols = GetGeneratingPosTags(child_symbol);
+        parent_symbols = &GetGeneratingPosTags(child_symbol);
       }
 
-      for (pair<string,double> ps : parent_symbols) {
+      for (pair<string,double> const& ps : *parent_symbols) {
         string parent_symbol = ps.first;
         double probability = ps.second * child_and_prob.second;
         printf("%.3e = %.3e * %.3e\n", probability, ps.second, child_and_prob.second);
@@ -191,7 +227,7 @@ ParseTableRow PCFG::BuildUnitaryParentRow(
 pTreeProb PCFG::BuildParentTree(NonTerm generator_symbol,
                                 double generation_prob,
                                 pTreeProb left_child,
-                                pTreeProb right_child) {
+                                pTreeProb right_child) const {
 
   shared_ptr<Tree<string> > left_tree = left_child.first;
   double left_prob = left_child.second;
@@ -218,59 +254,59 @@ pTreeProb PCFG::BuildParentTree(NonTerm generator_symbol,
  * 
  * If a NonTerminal has several generation possibilities only the one with
  * highest probability is returned
+ *
+ * left_symbols and right_symbols are the bitsets of the root symbols in
+ * 'left' and 'right'. Most splits cannot produce anything, which the
+ * bitsets detect with a few ANDs before any rule is looked up.
  */
-vector<pTreeProb> PCFG::BuildParentTrees(vector<pTreeProb> left, 
-                                         vector<pTreeProb> right) {
-  // Find symbols that can generate tree symbols in left and right
-  // Mapping is a bit complicated because the symbol search is string based
-  // but the cells contain tree structures. So we need a mapping 
-  // from strings to Trees.
-  map<string,pTreeProb> left_targets;
-  std::set<pair<Rule, double> > generators_left;
-  for (pTreeProb ptp : left) {
-    string node_symbol = ptp.first->value_;
-    left_targets[node_symbol] = ptp;
-    auto generators = generate_left[node_symbol];
-    generators_left.insert(generators.begin(), generators.end());
-  }
-  map<string, pTreeProb> right_targets;
-  std::set<pair<Rule, double> > generators_right;
-  for (pTreeProb ptp : right) {
-    string node_symbol = ptp.first->value_;
-    right_targets[node_symbol] = ptp;
-    auto generators = generate_right[node_symbol];
-    generators_right.insert(generators.begin(), generators.end());
-  }
-
-  vector<pair<Rule, double> > generators;
-  std::set_intersection(generators_left.begin(), generators_left.end(),
-                        generators_right.begin(), generators_right.end(),
-                        std::back_inserter(generators));
-  
+vector<pTreeProb> PCFG::BuildParentTrees(vector<pTreeProb> const & left,
+                                         vector<pTreeProb> const & right,
+                                         SymbolSet const & left_symbols,
+                                         SymbolSet const & right_symbols) const {
+  vector<pTreeProb> parent_trees_;
+  if (!left_symbols.Intersects(left_children_) ||
+      !right_symbols.Intersects(right_children_)) {
+    return parent_trees_;
+  }
+
   map<NonTerm, pTreeProb> parent_trees;
-  // Create a new tree for every found generator
-  for (pair<Rule, double> generator : generators) {
-    NonTerm generator_symbol = generator.first.left_;
-    double generator_probability = generator.second;
-    Rule rule = generator.first;
-    pTreeProb left_child = left_targets[rule.right_[0]];
-    pTreeProb right_child = right_targets[rule.right_[1]];
-    pTreeProb parent = BuildParentTree(generator_symbol,
-                                       generator_probability,
-                                       left_child, 
-                                       right_child);
-    // Only save one tree per symbol as we search the max likelihood tree
-    bool new_symbol = parent_trees.find(generator_symbol) == parent_trees.end();
-    bool higher_probability = false;
-    if (!new_symbol) {
-      higher_probability = parent_trees[generator_symbol].second < parent.second;
-    }
-    if (new_symbol || higher_probability) {
-      parent_trees[generator_symbol] = parent;
+  for (pTreeProb const & left_child : left) {
+    auto left_id = non_term_ids_.find(left_child.first->value_);
+    if (left_id == non_term_ids_.end()) continue;
+    // Rules with this left child need one of their right children in 'right'
+    SymbolSet const & accepted = right_children_of_[left_id->second];
+    if (!accepted.Intersects(right_symbols)) continue;
+
+    for (pTreeProb const & right_child : right) {
+      auto right_id = non_term_ids_.find(right_child.first->value_);
+      if (right_id == non_term_ids_.end()) continue;
+      if (!accepted.Contains(right_id->second)) continue;
+
+      // Create a new tree for every found generator
+      auto generators = reverse_grammar_binary_.find(pair<NonTerm, NonTerm>(
+          left_child.first->value_, right_child.first->value_));
+      for (pair<Rule, double> const & generator : generators->second) {
+        NonTerm generator_symbol = generator.first.left_;
+        double generator_probability = generator.second;
+        pTreeProb parent = BuildParentTree(generator_symbol,
+                                           generator_probability,
+                                           left_child,
+                                           right_child);
+        // Only save one tree per symbol as we search the max likelihood tree
+        bool new_symbol =
+            parent_trees.find(generator_symbol) == parent_trees.end();
+        bool higher_probability = false;
+        if (!new_symbol) {
+          higher_probability =
+              parent_trees[generator_symbol].second < parent.second;
+        }
+        if (new_symbol || higher_probability) {
+          parent_trees[generator_symbol] = parent;
+        }
+      }
     }
   }
 
-  vector<pTreeProb> parent_trees_;
   for (auto it = parent_trees.begin(); it != parent_trees.end(); ++it) {
     pTreeProb ptb = it->second;
     parent_trees_.push_back(ptb);
@@ -279,6 +315,22 @@ vector<pTreeProb> PCFG::BuildParentTrees(vector<pTreeProb> left,
   return parent_trees_;
 }
 
+/**
+ * Bitset of the root symbols of the trees in every cell of row
+ */
+SymbolSetRow PCFG::BuildSymbolSetRow(ParseTableRow const & row) const {
+  SymbolSetRow symbols;
+  for (vector<pTreeProb> const & cell : row) {
+    SymbolSet cell_symbols(non_term_ids_.size());
+    for (pTreeProb const & ptb : cell) {
+      auto id = non_term_ids_.find(ptb.first->value_);
+      if (id != non_term_ids_.end()) cell_symbols.Insert(id->second);
+    }
+    symbols.push_back(cell_symbols);
+  }
+  return symbols;
+}
+
 /**
  * Generates the next row in a valid CYK table
  * 
@@ -296,7 +348,8 @@ vector<pTreeProb> PCFG::BuildParentTrees(vector<pTreeProb> left,
  * table[1] ->  |  POS-Tags |  POS-Tags  |  POS-Tags  |  POS-Tags  |  POS-Tags  | 
  * table[0] ->  |  token_0  |  token_1   |  token_2   |  token_3   |  token_4   |   
  */
-ParseTableRow PCFG::BuildBinaryParentRow(vector<ParseTableRow> const & table) {
+ParseTableRow PCFG::BuildBinaryParentRow(vector<ParseTableRow> const & table,
+                                         vector<SymbolSetRow> const & symbols) const {
   ParseTableRow row;
   int n_cells = table.back().size()-1;
   int generation_length = table.size()-1;
@@ -314,7 +367,12 @@ ParseTableRow PCFG::BuildBinaryParentRow(vector<ParseTableRow> const & table) {
       vector<pTreeProb> const & left_cell = table[left_length+1][start];
       vector<pTreeProb> const & right_cell = table[right_length+1][left_end+1];
       
-      vector<pTreeProb> parent_trees = BuildParentTrees(left_cell, right_cell);
+      SymbolSet const & left_symbols = symbols[left_length+1][start];
+      SymbolSet const & right_symbols = symbols[right_length+1][left_end+1];
+      
+      vector<pTreeProb> parent_trees = BuildParentTrees(left_cell, right_cell,
+                                                        left_symbols,
+                                                        right_symbols);
       // Store all new or new most likely trees (only most likely cuz MLE)
       for (pTreeProb ptb : parent_trees) {
         NonTerm parent_symbol = ptb.first->value_;
@@ -348,7 +406,7 @@ Algorithm overview:
 We fill a table where cell (y,x) contains trees that can dissolve to
 create tokens (t[x],...,t[x+y-1])
 */
-shared_ptr<Tree<string> > PCFG::ParseSentence(vector<string> tokens) { 
+shared_ptr<Tree<string> > PCFG::ParseSentence(vector<string> tokens) const {
   printf("\n%i tokens\n", tokens.size());
   vector<ParseTableRow> table;
 
@@ -362,6 +420,11 @@ shared_ptr<Tree<string> > PCFG::ParseSentence(vector<string> tokens) {
   // Third lowest row contains NonTerminals that generate the Pos-Tags
   // By unitary rules
   table.push_back(BuildUnitaryParentRow(table[1], POS_TAG));
+
+  // Bitsets of the symbols in each cell, parallel to the table.
+  // Only rows of NonTerminals (table[2] and above) are ever combined.
+  vector<SymbolSetRow> symbols(2);
+  symbols.push_back(BuildSymbolSetRow(table[2]));
   
   // Higher rows contain non terminals that generate the symbols in
   // lower rows. Elements of the lowest row (table[2]) generate single POS-Tags,
@@ -369,7 +432,8 @@ shared_ptr<Tree<string> > PCFG::ParseSentence(vector<string> tokens) {
   // Elements on level x eventually dissolve into x-1 tokens
   for (int level=3; level <= tokens.size()+1; level++) {
     printf("table[%i]\n", level);
-    table.push_back(BuildBinaryParentRow(table));
+    table.push_back(BuildBinaryParentRow(table, symbols));
+    symbols.push_back(BuildSymbolSetRow(table.back()));
   }
 
   int count_trees = 0;
@@ -385,7 +449,7 @@ shared_ptr<Tree<string> > PCFG::ParseSentence(vector<string> tokens) {
   return mle.first;
 }
 
-pTreeProb PCFG::GetMostLikely(vector<pTreeProb> ptbs) {
+pTreeProb PCFG::GetMostLikely(vector<pTreeProb> ptbs) const {
   pTreeProb best;
   double best_probability = -1;
   for (pTreeProb ptb : ptbs) {
@@ -398,6 +462,99 @@ pTreeProb PCFG::GetMostLikely(vector<pTreeProb> ptbs) {
 }
 
 
+/**
+ * Same table layout as ParseSentence, but every cell maps each symbol to a
+ * node of a packed forest, and every rule application that can build the
+ * symbol becomes an incoming hyperedge of that node. Nothing is discarded,
+ * so after the bottom up pass the forest holds all derivations, while their
+ * enumeration is left to the lazy k-best extraction.
+ */
+vector<pTreeProb> PCFG::ParseSentenceKBest(vector<string> tokens, int k) const {
+  int n = tokens.size();
+  if (n == 0) return vector<pTreeProb>();
+  Hypergraph forest;
+  // nodes[length][start]: symbol -> forest node spanning tokens[start..]
+  vector<vector<map<string, int> > > nodes(n + 1);
+  for (int length = 1; length <= n; length++) {
+    nodes[length].resize(n - length + 1);
+  }
+
+  for (int i = 0; i < n; i++) {
+    int token_node = forest.AddNode(tokens[i]);
+    forest.AddEdge(token_node, 0.0, vector<int>());
+
+    // POS-Tags that generate the token
+    map<string, int> pos_nodes;
+    for (pair<PosTag, double> const& ps : GetGeneratingPosTags(tokens[i])) {
+      int pos_node = forest.AddNode(ps.first);
+      forest.AddEdge(pos_node, std::log(ps.second), {token_node});
+      pos_nodes[ps.first] = pos_node;
+    }
+
+    // NonTerminals that generate the POS-Tags by unitary rules
+    for (auto const& it : pos_nodes) {
+      auto grammar_entry = reverse_grammar_single_.find(it.first);
+      if (grammar_entry == reverse_grammar_single_.end()) continue;
+      for (pair<NonTerm, double> const& ps : grammar_entry->second) {
+        auto found = nodes[1][i].find(ps.first);
+        int nt_node;
+        if (found == nodes[1][i].end()) {
+          nt_node = forest.AddNode(ps.first);
+          nodes[1][i][ps.first] = nt_node;
+        } else {
+          nt_node = found->second;
+        }
+        forest.AddEdge(nt_node, std::log(ps.second), {it.second});
+      }
+    }
+  }
+
+  // Binary rules (N -> (A,B)) with A in S_(start,left_end) and
+  // B in S_(left_end+1,end)
+  for (int length = 2; length <= n; length++) {
+    for (int start = 0; start + length <= n; start++) {
+      map<string, int>& cell = nodes[length][start];
+      for (int left_length = 1; left_length < length; left_length++) {
+        map<string, int> const& left_cell = nodes[left_length][start];
+        map<string, int> const& right_cell =
+            nodes[length - left_length][start + left_length];
+        for (auto const& left : left_cell) {
+          for (auto const& right : right_cell) {
+            auto generators = reverse_grammar_binary_.find(
+                pair<NonTerm, NonTerm>(left.first, right.first));
+            if (generators == reverse_grammar_binary_.end()) continue;
+            for (pair<Rule, double> const& generator : generators->second) {
+              NonTerm const& parent_symbol = generator.first.left_;
+              auto found = cell.find(parent_symbol);
+              int parent_node;
+              if (found == cell.end()) {
+                parent_node = forest.AddNode(parent_symbol);
+                cell[parent_symbol] = parent_node;
+              } else {
+                parent_node = found->second;
+              }
+              forest.AddEdge(parent_node, std::log(generator.second),
+                             {left.second, right.second});
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // The trees are rooted at SENT if the top cell has it. Otherwise (as in
+  // DenseParser) a virtual super root joins all symbols of the top cell, so
+  // the k best trees are searched across root symbols.
+  map<string, int> const& top = nodes[n][0];
+  auto sentence = top.find("SENT");
+  if (sentence != top.end()) return forest.KBest(sentence->second, k);
+  int root = forest.AddNode("");
+  for (auto const& it : top) {
+    forest.AddEdge(root, 0.0, {it.second});
+  }
+  return forest.KBest(root, k);
+}
+
 void extract_rules(Tree<std::string>* t, vector<Rule>& grammar_rules,
                    vector<Rule>& lexicon_rules, set<string>& vocab,
                    set<string>& pos_tags, set<string>& non_terminals,
@@ -443,61 +600,98 @@ void extract_rules(Tree<std::string>* t, vector<Rule>& grammar_rules,
 }
 
 /**
- * Restructures the rules in a way that gives for each rule the observed
- * frequency that the left handside of the rule has dissolved following this
- * rule
- * Returns a map string -> vector<pair(Rule, double)>
- * e.g. If rules contains only the three rules(A -> B C), (A -> B E), (A -> B C)
- * The return would be {(A -> B C) -> 0.667, (A -> B E) -> 0.333}
+ * Gives for each rule the observed frequency that the left handside of the
+ * rule has dissolved following this rule
+ * e.g. If counts contains (A -> B C): 2, (A -> B E): 1
+ * The output would be {(A -> B C) -> 0.667, (A -> B E) -> 0.333}
  */
-void CountsToProbabilities(vector<Rule>& rules, map<Rule, double>& out) {
-  map<string, int> left_handside_count;
-  map<Rule, int> rule_count;
-
-  for (Rule r : rules) {
-    if (left_handside_count.find(r.left_) == left_handside_count.end()) {
-      left_handside_count[r.left_] = 1;
-    } else {
-      left_handside_count[r.left_]++;
-    }
-    if (rule_count.find(r) == rule_count.end()) {
-      rule_count[r] = 1;
-    } else {
-      rule_count[r]++;
-    }
+void CountsToProbabilities(map<Rule, double> const& counts,
+                           map<Rule, double>& out) {
+  map<string, double> left_handside_count;
+  for (auto const& it : counts) {
+    left_handside_count[it.first.left_] += it.second;
   }
-
-  for (Rule r : rules) {
-    double prob = ((double)rule_count[r]) / left_handside_count[r.left_];
-    out[r] = prob;
+  for (auto const& it : counts) {
+    out[it.first] = it.second / left_handside_count[it.first.left_];
   }
 }
 
-PCFG InferePCFG(vector<shared_ptr<Tree<string> > >& trees) {
-  set<string> non_terminals;
-  set<string> pos_tags;
-  set<string> vocab;
-
+void RuleCounts::AddTree(Tree<string>* t) {
   vector<Rule> grammar_rules;
   vector<Rule> lexicon_rules;
+  extract_rules(t, grammar_rules, lexicon_rules, vocab_, pos_tags_,
+                non_terminals_);
+  for (Rule const& rule : grammar_rules) grammar_counts_[rule]++;
+  for (Rule const& rule : lexicon_rules) lexicon_counts_[rule]++;
+  // extract_rules visits the leaves from right to left
+  vector<string> trigram{"", "", ""};
+  for (size_t i = lexicon_rules.size() + 1; i > 0; i--) {
+    trigram[0] = trigram[1];
+    trigram[1] = trigram[2];
+    trigram[2] = i > 1 ? lexicon_rules[i - 2].left_ : "";
+    tag_trigram_counts_[trigram]++;
+  }
+}
 
-  for (shared_ptr<Tree<string> > t : trees) {
-    extract_rules(t.get(), grammar_rules, lexicon_rules, vocab, pos_tags,
-                  non_terminals);
+long CountTreebank(std::istream& in, RuleCounts& counts, int horizontal_order,
+                   int vertical_order) {
+  long n_trees = 0;
+  string line;
+  while (getline(in, line)) {
+    shared_ptr<Tree<string> > t = ParseTree(line);
+    if (!t->HasChildren()) continue;
+    NormalizeTree(t.get(), horizontal_order, vertical_order);
+    counts.AddTree(t.get());
+    n_trees++;
+  }
+  return n_trees;
+}
+
+PCFG EstimatePCFG(RuleCounts const& counts) {
+  map<Rule, double> lexicon_counts = counts.lexicon_counts_;
+
+  // Words seen only once stand in for unknown words: each of their
+  // observations is also counted for the word's signature
+  map<string, double> word_counts;
+  for (auto const& it : counts.lexicon_counts_) {
+    word_counts[it.first.right_[0]] += it.second;
+  }
+  for (auto const& it : counts.lexicon_counts_) {
+    string const& word = it.first.right_[0];
+    if (word_counts[word] == 1) {
+      lexicon_counts[Rule(it.first.left_, WordSignature(word))]++;
+    }
   }
 
   // To give every pos tag the possibility to emit an unknown word
   // we add the artificial observation pos -> <UNK> for every pos tag
-  for (string pos : pos_tags) {
-    lexicon_rules.push_back(Rule(pos, "<UNK>"));
+  for (string pos : counts.pos_tags_) {
+    lexicon_counts[Rule(pos, "<UNK>")]++;
   }
 
   map<Rule, double> lexicon_rule_probabilities;
   map<Rule, double> grammar_rule_probabilities;
-  CountsToProbabilities(lexicon_rules, lexicon_rule_probabilities);
-  CountsToProbabilities(grammar_rules, grammar_rule_probabilities);
+  CountsToProbabilities(lexicon_counts, lexicon_rule_probabilities);
+  CountsToProbabilities(counts.grammar_counts_, grammar_rule_probabilities);
 
+  set<string> non_terminals = counts.non_terminals_;
+  set<string> pos_tags = counts.pos_tags_;
+  set<string> vocab = counts.vocab_;
   PCFG pcfg(non_terminals, pos_tags, vocab, lexicon_rule_probabilities,
             grammar_rule_probabilities);
   return pcfg;
-}
\ No newline at end of file
+}
+
+PCFG InferePCFG(vector<shared_ptr<Tree<string> > >& trees,
+                TrigramTagger* tagger) {
+  RuleCounts counts;
+  for (shared_ptr<Tree<string> > t : trees) {
+    counts.AddTree(t.get());
+  }
+  if (tagger != nullptr) {
+    *tagger = TrigramTagger(
+        vector<string>(counts.pos_tags_.begin(), counts.pos_tags_.end()),
+        counts.tag_trigram_counts_);
+  }
+  return EstimatePCFG(counts);
+}
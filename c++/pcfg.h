@@ -1,12 +1,15 @@
 #ifndef PCFG_H
 #define PCFG_H
 
+#include <istream>
 #include <map>
 #include <set>
 #include <string>
 #include <vector>
 #include <functional>
 
+#include "perfect_hash.h"
+#include "symbol_set.h"
 #include "tree.h"
 
 using std::string;
@@ -16,10 +19,13 @@ using std::multiset;
 using std::set;
 using std::pair;
 
+class TrigramTagger;
+
 typedef string NonTerm;
 typedef string PosTag;
 typedef string Token;
 typedef vector<vector<pTreeProb> > ParseTableRow;
+typedef vector<SymbolSet> SymbolSetRow;
 
 // Represents a rule of a probabilistic context free grammar
 // left_: left handside of a rule
@@ -65,52 +71,115 @@ class PCFG {
   // Structures to help reverse searching for rules when given a 
   // Token / POSTag / NonTerm that shall be generated. Gives possible
   // Generators with corresponding generation probabilities.
-  map<Token, vector<pair<PosTag, double> > > reverse_lexicon_;
+  // Lexicon (word --> POS-tags) under a perfect hash, slot i generates
+  // lexicon_pos_tags_[i]. Also holds <UNK> and the word signatures.
+  PerfectHash lexicon_hash_;
+  vector<vector<pair<PosTag, double> > > lexicon_pos_tags_;
   map<PosTag, vector<pair<NonTerm, double> > > reverse_grammar_single_;
   map<pair<NonTerm, NonTerm>, vector<pair<Rule, double> > >
       reverse_grammar_binary_;
-  // ? -> (NonTerm, .),  ? -> (., NonTerm)
-  map<NonTerm, vector<pair<Rule, double> > > generate_left;
-  map<NonTerm, vector<pair<Rule, double> > > generate_right;
+
+  // Bitset filters for binary rules (N -> (A,B)). Bits are NonTerm ids.
+  // left_children_: all A, right_children_: all B,
+  // right_children_of_[id of A]: all B that can follow A
+  map<NonTerm, int> non_term_ids_;
+  SymbolSet left_children_;
+  SymbolSet right_children_;
+  vector<SymbolSet> right_children_of_;
 
   PCFG(set<string>& non_terminals, set<string>& pos_tags, set<string>& vocab,
        map<Rule, double>& lexicon_probs, map<Rule, double>& grammar_probs);
 
   // Searches for all nonterminals that can generate the given nonterminal pair.
   // Returns these NTs with their probability to dissolve to the given pair.
-  vector<pair<Rule, double> > GetGeneratingNonTerms(string left_nt,
-                                                      string right_nt);
+  // The Get* lookups do not modify the PCFG; the returned references stay
+  // valid as long as the PCFG. Like the parse functions below they are
+  // const, so one PCFG can be shared by any number of threads.
+  vector<pair<Rule, double> > const& GetGeneratingNonTerms(
+      string const& left_nt, string const& right_nt) const;
   // Searches for all nonterminals that can generate the single pos_tag
   // (pos_tag = terminal of the grammar)
   // Returns these NTs with their probability to dissolve to the given POS tag
-  vector<pair<string, double> > GetGeneratingNonTerms(string pos_tag);
+  vector<pair<string, double> > const& GetGeneratingNonTerms(
+      string const& pos_tag) const;
   // Searches all POS-tags that can generate the given word.
   // Returns those POS-tags with their probability to generate the given word.
-  vector<pair<string, double> > GetGeneratingPosTags(string word);
+  // Unknown words are looked up by their signature (see WordSignature),
+  // then as <UNK>.
+  vector<pair<string, double> > const& GetGeneratingPosTags(
+      string const& word) const;
 
   // Computes the Maximum Likelihood Constituency Tree to produce the given
   // sequence of words(=tokens).
-  shared_ptr<Tree<string> > ParseSentence(vector<string> tokens);
+  shared_ptr<Tree<string> > ParseSentence(vector<string> tokens) const;
+
+  // Computes the k most likely constituency trees for the given sequence of
+  // words, best first. Unlike ParseSentence the chart keeps every way to
+  // build a symbol (not only the best one) as a packed forest, from which
+  // the trees are extracted lazily.
+  // The second entry of each returned pair is the log probability of the tree.
+  vector<pTreeProb> ParseSentenceKBest(vector<string> tokens, int k) const;
 
  private:
-  ParseTableRow BuildTokenRow(vector<string> const& tokens);
+  ParseTableRow BuildTokenRow(vector<string> const& tokens) const;
   ParseTableRow BuildUnitaryParentRow( 
           ParseTableRow const & children_row,
-          SYMBOL_TYPE);
-  ParseTableRow BuildBinaryParentRow(vector<ParseTableRow> const & table);
+          SYMBOL_TYPE) const;
+  ParseTableRow BuildBinaryParentRow(vector<ParseTableRow> const & table,
+                                     vector<SymbolSetRow> const & symbols) const;
   pTreeProb BuildParentTree(NonTerm generator_symbol,
                             double generation_prob,
                             pTreeProb left_child,
-                            pTreeProb right_child);
-  vector<pTreeProb> BuildParentTrees(vector<pTreeProb> left, 
-                                           vector<pTreeProb> right);
-  pTreeProb GetMostLikely(vector<pTreeProb> ptbs);
+                            pTreeProb right_child) const;
+  vector<pTreeProb> BuildParentTrees(vector<pTreeProb> const & left,
+                                     vector<pTreeProb> const & right,
+                                     SymbolSet const & left_symbols,
+                                     SymbolSet const & right_symbols) const;
+  SymbolSetRow BuildSymbolSetRow(ParseTableRow const & row) const;
+  pTreeProb GetMostLikely(vector<pTreeProb> ptbs) const;
+
+};
 
+// Observed rule frequencies of a treebank, from which EstimatePCFG takes
+// the probabilities. Keeping the counts apart allows to reduce or smooth
+// the grammar before the estimation (see ReduceGrammar).
+class RuleCounts {
+ public:
+  set<string> non_terminals_;
+  set<string> pos_tags_;
+  set<string> vocab_;
+  // NonTerm -> (NonTerm, NonTerm) and NonTerm -> POS-tag
+  map<Rule, double> grammar_counts_;
+  // POS-tag -> word
+  map<Rule, double> lexicon_counts_;
+  // POS-tag trigrams, "" is the sentence boundary (see TrigramTagger)
+  map<vector<string>, double> tag_trigram_counts_;
+
+  // Counts the rules and POS-tag trigrams of the normalized tree t.
+  // Memory grows with the number of distinct rules, not with the number
+  // of trees.
+  void AddTree(Tree<string>* t);
 };
 
+// Relative frequencies of the rules per left hand side.
+// Words seen once are also counted for their signature (see WordSignature)
+// and every POS-tag emits the artificial word <UNK> once.
+PCFG EstimatePCFG(RuleCounts const& counts);
+
+// Streaming training: reads one bracketed tree per line from in (lines
+// that are no tree are skipped), normalizes it (see NormalizeTree), counts
+// it and drops it, so treebanks larger than the memory can be used.
+// Returns the number of trees.
+long CountTreebank(std::istream& in, RuleCounts& counts,
+                   int horizontal_order = -1, int vertical_order = 1);
+
 // Inferes a PCFG from the rules of the normalized trees
 // Returns a pointer to that PCFG
-PCFG InferePCFG(vector<shared_ptr<Tree<string> > >& trees);
+// If tagger is given, a trigram POS-tagger is trained on the POS-tag
+// sequences of the trees in the same pass.
+// Same as EstimatePCFG with the counts of the trees.
+PCFG InferePCFG(vector<shared_ptr<Tree<string> > >& trees,
+                TrigramTagger* tagger = nullptr);
 
 // Extracts all rules from the tree t and inserts them either in
 // grammar_rules or lexicon_rules
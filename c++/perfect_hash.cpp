@@ -0,0 +1,127 @@
+#include "perfect_hash.h"
+
+#include <algorithm>
+
+// Hash salts tried before giving up
+static const int kMaxSalts = 8;
+// Seeds tried per bucket are kSeedsPerKey times the number of keys. The last
+// buckets see about one free slot, so a seed fits with probability 1/n and
+// the bound fails with probability about e^-kSeedsPerKey.
+static const uint64_t kSeedsPerKey = 32;
+
+// FNV-1a, with the salt mixed into the offset basis
+static uint64_t Hash(string_view key, uint64_t salt) {
+  uint64_t hash = 14695981039346656037ULL ^ salt;
+  for (char c : key) {
+    hash ^= (unsigned char)c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// splitmix64 finalizer, gives an independent hash for every seed
+static uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+uint32_t PerfectHash::Slot(uint64_t hash, uint32_t seed) const {
+  uint64_t n = key_offsets_.size() - 1;
+  return Mix(hash + seed * 0x9e3779b97f4a7c15ULL) % n;
+}
+
+PerfectHash::PerfectHash(vector<string> const& keys) : salt_(0), ok_(true) {
+  for (int attempt = 0; attempt < kMaxSalts; attempt++) {
+    salt_ = Mix(attempt);
+    bool duplicate = false;
+    if (Build(keys, duplicate)) return;
+    if (duplicate) break;
+  }
+  ok_ = false;
+  seeds_.clear();
+  key_pool_.clear();
+  key_offsets_.assign(1, 0);
+}
+
+bool PerfectHash::Build(vector<string> const& keys, bool& duplicate) {
+  size_t n = keys.size();
+  key_offsets_.assign(n + 1, 0);
+  if (n == 0) return true;
+  seeds_.assign(n / 4 + 1, 0);
+
+  vector<vector<int> > buckets(seeds_.size());
+  vector<uint64_t> hashes(n);
+  for (size_t i = 0; i < n; i++) {
+    hashes[i] = Hash(keys[i], salt_);
+    buckets[Mix(hashes[i]) % seeds_.size()].push_back(i);
+  }
+  vector<int> order(buckets.size());
+  for (size_t b = 0; b < buckets.size(); b++) order[b] = b;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  // Keys with equal hashes share a bucket and no seed can separate them
+  for (vector<int> const& bucket : buckets) {
+    for (size_t j = 0; j < bucket.size(); j++) {
+      for (size_t k = j + 1; k < bucket.size(); k++) {
+        if (hashes[bucket[j]] != hashes[bucket[k]]) continue;
+        duplicate = keys[bucket[j]] == keys[bucket[k]];
+        return false;
+      }
+    }
+  }
+
+  vector<int> key_of_slot(n, -1);
+  vector<uint32_t> slots;
+  uint64_t max_seed =
+      std::min<uint64_t>(kSeedsPerKey * n + 1024, UINT32_MAX - 1);
+  for (int b : order) {
+    if (buckets[b].empty()) break;
+    bool found = false;
+    for (uint32_t seed = 1; !found && seed <= max_seed; seed++) {
+      slots.clear();
+      bool ok = true;
+      for (int i : buckets[b]) {
+        uint32_t slot = Slot(hashes[i], seed);
+        if (key_of_slot[slot] >= 0 ||
+            std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+          ok = false;
+          break;
+        }
+        slots.push_back(slot);
+      }
+      if (!ok) continue;
+      for (size_t j = 0; j < slots.size(); j++) {
+        key_of_slot[slots[j]] = buckets[b][j];
+      }
+      seeds_[b] = seed;
+      found = true;
+    }
+    if (!found) return false;
+  }
+
+  key_pool_.clear();
+  for (size_t slot = 0; slot < n; slot++) {
+    key_pool_ += keys[key_of_slot[slot]];
+    key_offsets_[slot + 1] = key_pool_.size();
+  }
+  return true;
+}
+
+int PerfectHash::Find(string_view key) const {
+  if (seeds_.empty()) return -1;
+  uint64_t hash = Hash(key, salt_);
+  uint32_t slot = Slot(hash, seeds_[Mix(hash) % seeds_.size()]);
+  if (Key(slot) != key) return -1;
+  return slot;
+}
+
+string_view PerfectHash::Key(int slot) const {
+  return string_view(key_pool_).substr(
+      key_offsets_[slot], key_offsets_[slot + 1] - key_offsets_[slot]);
+}
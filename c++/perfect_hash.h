@@ -0,0 +1,58 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+// Static minimal perfect hash over a set of distinct strings (hash and displace,
+// "CHD"): the n keys are mapped to distinct slots 0..n-1.
+// Keys are first hashed into buckets of about 4 keys. For every bucket, the
+// largest first, a seed is searched that sends all its keys to free slots.
+// If two distinct keys have the same 64-bit hash, or a bucket finds no seed
+// within a bounded number of tries, the construction starts over with
+// another hash salt.
+// A lookup is two hashes and one string compare against the key stored in
+// the slot, so unknown strings are recognized as well.
+// The structure never changes after construction.
+//
+// The keys must be distinct. If they are not (or no salt works), the hash
+// is left empty: ok() is false and Find returns -1 for every key.
+class PerfectHash {
+ public:
+  PerfectHash() : salt_(0), ok_(true) { ; }
+  PerfectHash(vector<string> const& keys);
+
+  bool ok() const { return ok_; }
+
+  // Slot of key, -1 if key is not one of the keys
+  int Find(string_view key) const;
+  // Key stored in slot
+  string_view Key(int slot) const;
+  int size() const { return (int)key_offsets_.size() - 1; }
+  size_t MemoryBytes() const {
+    return (seeds_.capacity() + key_offsets_.capacity()) * sizeof(uint32_t) +
+           key_pool_.capacity();
+  }
+
+ private:
+  vector<uint32_t> seeds_;
+  // Keys in slot order, back to back
+  string key_pool_;
+  vector<uint32_t> key_offsets_;
+  uint64_t salt_;
+  bool ok_;
+
+  uint32_t Slot(uint64_t hash, uint32_t seed) const;
+  // One construction attempt with salt_. Returns false if it has to be
+  // repeated with another salt; duplicate is set if keys are repeated.
+  bool Build(vector<string> const& keys, bool& duplicate);
+};
+
+#endif
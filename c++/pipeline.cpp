@@ -0,0 +1,237 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+
+#include "tree_writer.h"
+
+using std::map;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Sums the statistics of the threads of one stage
+static StageStats Merge(string name, vector<StageStats> const& threads) {
+  StageStats stage;
+  stage.name_ = name;
+  stage.threads_ = threads.size();
+  for (StageStats const& thread : threads) {
+    stage.items_ += thread.items_;
+    stage.busy_seconds_ += thread.busy_seconds_;
+    stage.idle_seconds_ += thread.idle_seconds_;
+    stage.blocked_seconds_ += thread.blocked_seconds_;
+  }
+  return stage;
+}
+
+DocumentPipeline::DocumentPipeline(IndexedGrammar const& grammar,
+                                   Tokenizer const& tokenizer,
+                                   PipelineOptions const& options)
+    : grammar_(grammar), tokenizer_(tokenizer), options_(options),
+      corrector_(grammar) {
+  options_.tokenize_threads_ = std::max(1, options_.tokenize_threads_);
+  options_.correct_threads_ = std::max(1, options_.correct_threads_);
+  options_.parse_threads_ = std::max(1, options_.parse_threads_);
+  options_.serialize_threads_ = std::max(1, options_.serialize_threads_);
+  options_.reorder_window_ = std::max(1, options_.reorder_window_);
+}
+
+void DocumentPipeline::WriteWindow::WaitForRoom(long index, long window) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [&] { return index - written_ < window; });
+}
+
+void DocumentPipeline::WriteWindow::Written(long count) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    written_ = count;
+  }
+  changed_.notify_one();
+}
+
+void DocumentPipeline::Split(std::istream& in, ItemQueue& out,
+                             WriteWindow& window, StageStats& stats,
+                             long& num_documents) {
+  string document;
+  vector<string_view> sentences;
+  long index = 0;
+  Clock::time_point start = Clock::now();
+  while (getline(in, document)) {
+    tokenizer_.SplitSentences(document, sentences);
+    num_documents++;
+    size_t n_items = std::max<size_t>(1, sentences.size());
+    for (size_t i = 0; i < n_items; i++) {
+      ItemPtr item(new Item());
+      item->index_ = index++;
+      item->end_of_document_ = i + 1 == n_items;
+      item->empty_document_ = sentences.empty();
+      if (!sentences.empty()) item->text_ = string(sentences[i]);
+      item->partial_ = false;
+      Clock::time_point ready = Clock::now();
+      stats.busy_seconds_ += Seconds(start, ready);
+      window.WaitForRoom(item->index_, options_.reorder_window_);
+      out.Push(std::move(item));
+      start = Clock::now();
+      stats.blocked_seconds_ += Seconds(ready, start);
+      stats.items_++;
+    }
+  }
+  stats.busy_seconds_ += Seconds(start, Clock::now());
+  out.Close();
+}
+
+template <typename F>
+void DocumentPipeline::Work(ItemQueue& in, ItemQueue& out, F process,
+                            StageStats& stats, std::atomic<int>& running) {
+  ItemPtr item;
+  Clock::time_point start = Clock::now();
+  while (in.Pop(item)) {
+    Clock::time_point popped = Clock::now();
+    process(*item);
+    Clock::time_point done = Clock::now();
+    out.Push(std::move(item));
+    Clock::time_point pushed = Clock::now();
+    stats.idle_seconds_ += Seconds(start, popped);
+    stats.busy_seconds_ += Seconds(popped, done);
+    stats.blocked_seconds_ += Seconds(done, pushed);
+    stats.items_++;
+    start = pushed;
+  }
+  stats.idle_seconds_ += Seconds(start, Clock::now());
+  if (running.fetch_sub(1) == 1) out.Close();
+}
+
+void DocumentPipeline::Write(ItemQueue& in, std::ostream& out,
+                             WriteWindow& window, StageStats& stats,
+                             PipelineResult& result) {
+  // Sentences that overtook an earlier one, by index. Split never gets
+  // more than reorder_window_ sentences ahead of next, so it holds fewer
+  // than that.
+  map<long, ItemPtr> pending;
+  long next = 0;
+  ItemPtr item;
+  Clock::time_point start = Clock::now();
+  while (in.Pop(item)) {
+    Clock::time_point popped = Clock::now();
+    stats.idle_seconds_ += Seconds(start, popped);
+    pending[item->index_] = std::move(item);
+    for (auto it = pending.begin();
+         it != pending.end() && it->first == next; it = pending.erase(it)) {
+      Item const& sentence = *it->second;
+      if (!sentence.empty_document_) {
+        out << sentence.output_ << '\n';
+        if (sentence.partial_) result.num_partial_++;
+        if (sentence.parse_.first == nullptr) result.num_failed_++;
+        result.num_sentences_++;
+      }
+      if (sentence.end_of_document_) out << '\n';
+      stats.items_++;
+      next++;
+    }
+    window.Written(next);
+    start = Clock::now();
+    stats.busy_seconds_ += Seconds(popped, start);
+  }
+  stats.idle_seconds_ += Seconds(start, Clock::now());
+  out.flush();
+}
+
+PipelineResult DocumentPipeline::Run(std::istream& in, std::ostream& out) {
+  PipelineResult result;
+  Clock::time_point start = Clock::now();
+  size_t capacity = std::max(1, options_.queue_capacity_);
+  // queues[i] connects stage i and stage i+1
+  vector<unique_ptr<ItemQueue> > queues;
+  for (int i = 0; i < 5; i++) queues.emplace_back(new ItemQueue(capacity));
+
+  auto tokenize = [this](Item& item) {
+    tokenizer_.Tokenize(item.text_, item.tokens_);
+  };
+  auto correct = [this](Item& item) {
+    if (options_.correct_oov_) corrector_.Correct(item.tokens_, item.lattice_);
+  };
+  auto serialize = [](Item& item) {
+    if (item.parse_.first == nullptr) {
+      item.output_ = "(())";
+      return;
+    }
+    item.output_ = "( (";
+    WriteBracketString(item.parse_.first.get(), item.output_, true);
+    item.output_ += "))";
+  };
+
+  WriteWindow window;
+  StageStats split_stats;
+  StageStats write_stats;
+  vector<StageStats> tokenize_stats(options_.tokenize_threads_);
+  vector<StageStats> correct_stats(options_.correct_threads_);
+  vector<StageStats> parse_stats(options_.parse_threads_);
+  vector<StageStats> serialize_stats(options_.serialize_threads_);
+  std::atomic<int> tokenize_running(options_.tokenize_threads_);
+  std::atomic<int> correct_running(options_.correct_threads_);
+  std::atomic<int> parse_running(options_.parse_threads_);
+  std::atomic<int> serialize_running(options_.serialize_threads_);
+
+  vector<std::thread> threads;
+  threads.emplace_back([&] {
+    Split(in, *queues[0], window, split_stats, result.num_documents_);
+  });
+  for (int i = 0; i < options_.tokenize_threads_; i++) {
+    threads.emplace_back([&, i] {
+      Work(*queues[0], *queues[1], tokenize, tokenize_stats[i],
+           tokenize_running);
+    });
+  }
+  for (int i = 0; i < options_.correct_threads_; i++) {
+    threads.emplace_back([&, i] {
+      Work(*queues[1], *queues[2], correct, correct_stats[i],
+           correct_running);
+    });
+  }
+  for (int i = 0; i < options_.parse_threads_; i++) {
+    threads.emplace_back([&, i] {
+      // Every parse thread has its own chart
+      DenseParser parser(grammar_);
+      if (options_.max_parse_seconds_ > 0) {
+        parser.SetBudget(options_.max_parse_seconds_, 0);
+      }
+      auto parse = [this, &parser](Item& item) {
+        if (item.tokens_.empty()) return;
+        if (options_.correct_oov_) {
+          item.parse_ = parser.Parse(item.lattice_);
+        } else {
+          item.parse_ = parser.Parse(item.tokens_);
+        }
+        item.partial_ = parser.partial();
+      };
+      Work(*queues[2], *queues[3], parse, parse_stats[i], parse_running);
+    });
+  }
+  for (int i = 0; i < options_.serialize_threads_; i++) {
+    threads.emplace_back([&, i] {
+      Work(*queues[3], *queues[4], serialize, serialize_stats[i],
+           serialize_running);
+    });
+  }
+  // The calling thread writes
+  Write(*queues[4], out, window, write_stats, result);
+  for (std::thread& thread : threads) thread.join();
+
+  result.seconds_ = Seconds(start, Clock::now());
+  split_stats.name_ = "split";
+  split_stats.threads_ = 1;
+  write_stats.name_ = "write";
+  write_stats.threads_ = 1;
+  result.stages_.push_back(split_stats);
+  result.stages_.push_back(Merge("tokenize", tokenize_stats));
+  result.stages_.push_back(Merge("correct", correct_stats));
+  result.stages_.push_back(Merge("parse", parse_stats));
+  result.stages_.push_back(Merge("serialize", serialize_stats));
+  result.stages_.push_back(write_stats);
+  return result;
+}
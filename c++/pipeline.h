@@ -0,0 +1,142 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "dense_parser.h"
+#include "indexed_grammar.h"
+#include "oov.h"
+#include "tokenizer.h"
+#include "tree.h"
+
+using std::pair;
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+using std::vector;
+
+struct PipelineOptions {
+  // Worker threads per stage. Splitting reads the input and writing keeps
+  // the output order, both run on a single thread.
+  int tokenize_threads_ = 1;
+  int correct_threads_ = 1;
+  int parse_threads_ = 1;
+  int serialize_threads_ = 1;
+  // Sentences each queue between two stages can hold
+  int queue_capacity_ = 64;
+  // Sentences that may be split but not yet written. Split waits once this
+  // many are in flight, which bounds the writer's reorder buffer (and the
+  // memory of the whole pipeline) even while one long sentence holds up
+  // the output and the other parse threads keep going.
+  int reorder_window_ = 256;
+  // OOV correction (see OovCorrector), otherwise unknown words go through
+  // their signatures only
+  bool correct_oov_ = true;
+  // Parse budget per sentence (see DenseParser::SetBudget), 0 = none
+  double max_parse_seconds_ = 0;
+};
+
+// Time the threads of a stage spent working, waiting for input (idle) and
+// waiting for room in the next queue (blocked, i.e. backpressure)
+struct StageStats {
+  string name_;
+  int threads_ = 0;
+  long items_ = 0;
+  double busy_seconds_ = 0;
+  double idle_seconds_ = 0;
+  double blocked_seconds_ = 0;
+
+  double Utilization() const {
+    double total = busy_seconds_ + idle_seconds_ + blocked_seconds_;
+    return total > 0 ? busy_seconds_ / total : 0;
+  }
+};
+
+struct PipelineResult {
+  long num_documents_ = 0;
+  long num_sentences_ = 0;
+  long num_partial_ = 0;
+  long num_failed_ = 0;
+  double seconds_ = 0;
+  vector<StageStats> stages_;
+};
+
+// Runs raw documents through
+//   split -> tokenize -> correct -> parse -> serialize -> write
+// with a configurable number of threads per stage. The stages are connected
+// by bounded lock-free queues: a stage that runs ahead blocks on the full
+// queue in front of the next one, so memory stays bounded and the slowest
+// stage (parsing) always has sentences waiting.
+// Sentences carry their position in the input; the writer puts them back in
+// order with a reorder buffer, so the output does not depend on the number
+// of threads. At most reorder_window_ sentences are between split and
+// write at any time.
+//
+// Every input line is a document. The output has one tree per sentence in
+// the treebank format ("(())" if there is none) and an empty line after
+// every document. A line without sentences (e.g. a blank one) gives just
+// the empty line, so output documents match input lines one to one.
+class DocumentPipeline {
+ public:
+  DocumentPipeline(IndexedGrammar const& grammar, Tokenizer const& tokenizer,
+                   PipelineOptions const& options);
+
+  PipelineResult Run(std::istream& in, std::ostream& out);
+
+ private:
+  struct Item {
+    long index_;
+    bool end_of_document_;
+    // Stands for a document without sentences; it is not parsed or written
+    bool empty_document_;
+    string text_;
+    // Views into text_ or into the tokenizer
+    vector<string_view> tokens_;
+    vector<vector<pair<string, double> > > lattice_;
+    pTreeProb parse_;
+    bool partial_;
+    string output_;
+  };
+  typedef unique_ptr<Item> ItemPtr;
+  typedef BoundedQueue<ItemPtr> ItemQueue;
+
+  // Number of sentences written so far. Split waits on it so that sentence
+  // i is only split after sentence i - window was written.
+  class WriteWindow {
+   public:
+    void WaitForRoom(long index, long window);
+    void Written(long count);
+
+   private:
+    long written_ = 0;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+  };
+
+  IndexedGrammar const& grammar_;
+  Tokenizer const& tokenizer_;
+  PipelineOptions options_;
+  OovCorrector corrector_;
+
+  void Split(std::istream& in, ItemQueue& out, WriteWindow& window,
+             StageStats& stats, long& num_documents);
+  // One worker thread of a stage. The last worker of a stage to finish
+  // closes the queue to the next stage.
+  template <typename F>
+  void Work(ItemQueue& in, ItemQueue& out, F process, StageStats& stats,
+            std::atomic<int>& running);
+  void Write(ItemQueue& in, std::ostream& out, WriteWindow& window,
+             StageStats& stats, PipelineResult& result);
+};
+
+#endif
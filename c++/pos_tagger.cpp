@@ -0,0 +1,266 @@
+#include "pos_tagger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+using std::map;
+
+static const float kLogZero = -std::numeric_limits<float>::infinity();
+
+TrigramTagger::TrigramTagger(
+    vector<string> const& tags,
+    map<vector<string>, double> const& trigram_counts)
+    : tags_(tags), n_tags_(tags.size()) {
+  map<string, int> tag_ids;
+  for (int t = 0; t < n_tags_; t++) tag_ids[tags_[t]] = t;
+  tag_ids[""] = n_tags_;
+  size_t m = n_tags_ + 1;
+
+  // Counts of c after (a, b), of c after b and of c
+  vector<double> trigrams(m * m * m, 0), bigrams(m * m, 0), unigrams(m, 0);
+  double n_unigrams = 0;
+  for (auto const& it : trigram_counts) {
+    vector<string> const& trigram = it.first;
+    if (trigram.size() != 3 || !tag_ids.count(trigram[0]) ||
+        !tag_ids.count(trigram[1]) || !tag_ids.count(trigram[2])) {
+      continue;
+    }
+    int a = tag_ids[trigram[0]], b = tag_ids[trigram[1]];
+    int c = tag_ids[trigram[2]];
+    trigrams[(a * m + b) * m + c] += it.second;
+    bigrams[b * m + c] += it.second;
+    unigrams[c] += it.second;
+    n_unigrams += it.second;
+  }
+  // Context counts: (a, b) and b followed by anything
+  vector<double> trigram_contexts(m * m, 0), bigram_contexts(m, 0);
+  for (size_t ab = 0; ab < m * m; ab++) {
+    for (size_t c = 0; c < m; c++) {
+      trigram_contexts[ab] += trigrams[ab * m + c];
+    }
+  }
+  for (size_t b = 0; b < m; b++) {
+    for (size_t c = 0; c < m; c++) bigram_contexts[b] += bigrams[b * m + c];
+  }
+
+  // Deleted interpolation: every trigram votes with its count for the
+  // estimate that predicts it best when it is left out of the counts
+  double lambdas[3] = {0, 0, 0};
+  for (size_t a = 0; a < m; a++) {
+    for (size_t b = 0; b < m; b++) {
+      for (size_t c = 0; c < m; c++) {
+        double count = trigrams[(a * m + b) * m + c];
+        if (count == 0) continue;
+        double context = trigram_contexts[a * m + b];
+        double estimates[3] = {
+            n_unigrams > 1 ? (unigrams[c] - 1) / (n_unigrams - 1) : 0,
+            bigram_contexts[b] > 1
+                ? (bigrams[b * m + c] - 1) / (bigram_contexts[b] - 1) : 0,
+            context > 1 ? (count - 1) / (context - 1) : 0};
+        lambdas[std::max_element(estimates, estimates + 3) - estimates] +=
+            count;
+      }
+    }
+  }
+  double lambda_sum = lambdas[0] + lambdas[1] + lambdas[2];
+  for (double& lambda : lambdas) {
+    lambda = lambda_sum > 0 ? lambda / lambda_sum : 1.0 / 3;
+  }
+
+  log_transitions_.assign(m * m * m, kLogZero);
+  for (size_t a = 0; a < m; a++) {
+    for (size_t b = 0; b < m; b++) {
+      double context = trigram_contexts[a * m + b];
+      for (size_t c = 0; c < m; c++) {
+        double p = 0;
+        if (n_unigrams > 0) p += lambdas[0] * unigrams[c] / n_unigrams;
+        if (bigram_contexts[b] > 0) {
+          p += lambdas[1] * bigrams[b * m + c] / bigram_contexts[b];
+        }
+        if (context > 0) {
+          p += lambdas[2] * trigrams[(a * m + b) * m + c] / context;
+        }
+        if (p > 0) log_transitions_[(a * m + b) * m + c] = log(p);
+      }
+    }
+  }
+}
+
+void TrigramTagger::PossibleTags(float const* emissions, int n,
+                                 vector<vector<int> >& possible) const {
+  possible.assign(n + 2, vector<int>());
+  possible[0].push_back(n_tags_);
+  possible[1].push_back(n_tags_);
+  for (int i = 0; i < n; i++) {
+    for (int t = 0; t < n_tags_; t++) {
+      if (emissions[(size_t)i * n_tags_ + t] != kLogZero) {
+        possible[i + 2].push_back(t);
+      }
+    }
+  }
+}
+
+void TrigramTagger::Viterbi(float const* emissions, int n,
+                            vector<int>& tags) const {
+  tags.clear();
+  if (n == 0 || empty()) return;
+  vector<vector<int> > possible;
+  PossibleTags(emissions, n, possible);
+  // delta[i][b * |possible[i + 2]| + c]: best log score of the tags up to
+  // position i that end with (b, c), back[i]: the a of that path
+  vector<vector<float> > delta(n + 1);
+  vector<vector<int> > back(n + 1);
+  delta[0].assign(1, 0);  // (boundary, boundary)
+  for (int i = 0; i < n; i++) {
+    vector<int> const& as = possible[i];
+    vector<int> const& bs = possible[i + 1];
+    vector<int> const& cs = possible[i + 2];
+    if (cs.empty()) return;
+    delta[i + 1].assign(bs.size() * cs.size(), kLogZero);
+    back[i + 1].assign(bs.size() * cs.size(), -1);
+    for (size_t bi = 0; bi < bs.size(); bi++) {
+      for (size_t ci = 0; ci < cs.size(); ci++) {
+        float best = kLogZero;
+        int best_a = -1;
+        for (size_t ai = 0; ai < as.size(); ai++) {
+          float score = delta[i][ai * bs.size() + bi] +
+                        LogTransition(as[ai], bs[bi], cs[ci]);
+          if (score > best) {
+            best = score;
+            best_a = ai;
+          }
+        }
+        delta[i + 1][bi * cs.size() + ci] =
+            best + emissions[(size_t)i * n_tags_ + cs[ci]];
+        back[i + 1][bi * cs.size() + ci] = best_a;
+      }
+    }
+  }
+  // Transition to the boundary after the last tag
+  vector<int> const& bs = possible[n];
+  vector<int> const& cs = possible[n + 1];
+  float best = kLogZero;
+  int best_b = -1, best_c = -1;
+  for (size_t bi = 0; bi < bs.size(); bi++) {
+    for (size_t ci = 0; ci < cs.size(); ci++) {
+      float score = delta[n][bi * cs.size() + ci] +
+                    LogTransition(bs[bi], cs[ci], n_tags_);
+      if (score > best) {
+        best = score;
+        best_b = bi;
+        best_c = ci;
+      }
+    }
+  }
+  if (best == kLogZero) return;
+  tags.resize(n);
+  for (int i = n - 1; i >= 0; i--) {
+    tags[i] = possible[i + 2][best_c];
+    int a = back[i + 1][best_b * possible[i + 2].size() + best_c];
+    best_c = best_b;
+    best_b = a;
+  }
+}
+
+void TrigramTagger::Posteriors(float const* emissions, int n,
+                               vector<double>& posteriors) const {
+  posteriors.assign((size_t)n * n_tags_, 0);
+  if (n == 0 || empty()) return;
+  vector<vector<int> > possible;
+  PossibleTags(emissions, n, possible);
+  for (int i = 0; i < n; i++) {
+    if (possible[i + 2].empty()) return;
+  }
+  // Emission probabilities, scaled per position
+  vector<vector<double> > emission(n);
+  for (int i = 0; i < n; i++) {
+    float const* row = emissions + (size_t)i * n_tags_;
+    float max_score = kLogZero;
+    for (int c : possible[i + 2]) max_score = std::max(max_score, row[c]);
+    for (int c : possible[i + 2]) {
+      emission[i].push_back(exp(row[c] - max_score));
+    }
+  }
+  auto transition = [this](int a, int b, int c) {
+    return exp((double)LogTransition(a, b, c));
+  };
+  auto normalize = [](vector<double>& values) {
+    double sum = 0;
+    for (double v : values) sum += v;
+    if (sum > 0) {
+      for (double& v : values) v /= sum;
+    }
+  };
+
+  // alpha[i + 1][b * |possible[i + 2]| + c], states as in Viterbi.
+  // Every position is scaled to sum 1, which cancels in the posteriors.
+  vector<vector<double> > alpha(n + 1);
+  alpha[0].assign(1, 1);
+  for (int i = 0; i < n; i++) {
+    vector<int> const& as = possible[i];
+    vector<int> const& bs = possible[i + 1];
+    vector<int> const& cs = possible[i + 2];
+    alpha[i + 1].assign(bs.size() * cs.size(), 0);
+    for (size_t bi = 0; bi < bs.size(); bi++) {
+      for (size_t ci = 0; ci < cs.size(); ci++) {
+        double sum = 0;
+        for (size_t ai = 0; ai < as.size(); ai++) {
+          sum += alpha[i][ai * bs.size() + bi] *
+                 transition(as[ai], bs[bi], cs[ci]);
+        }
+        alpha[i + 1][bi * cs.size() + ci] = sum * emission[i][ci];
+      }
+    }
+    normalize(alpha[i + 1]);
+  }
+  // beta[i + 1]: same states, probability of the rest of the sentence
+  vector<vector<double> > beta(n + 1);
+  {
+    vector<int> const& bs = possible[n];
+    vector<int> const& cs = possible[n + 1];
+    beta[n].assign(bs.size() * cs.size(), 0);
+    for (size_t bi = 0; bi < bs.size(); bi++) {
+      for (size_t ci = 0; ci < cs.size(); ci++) {
+        beta[n][bi * cs.size() + ci] = transition(bs[bi], cs[ci], n_tags_);
+      }
+    }
+    normalize(beta[n]);
+  }
+  for (int i = n - 2; i >= 0; i--) {
+    vector<int> const& bs = possible[i + 1];
+    vector<int> const& cs = possible[i + 2];
+    vector<int> const& ds = possible[i + 3];
+    beta[i + 1].assign(bs.size() * cs.size(), 0);
+    for (size_t bi = 0; bi < bs.size(); bi++) {
+      for (size_t ci = 0; ci < cs.size(); ci++) {
+        double sum = 0;
+        for (size_t di = 0; di < ds.size(); di++) {
+          sum += transition(bs[bi], cs[ci], ds[di]) * emission[i + 1][di] *
+                 beta[i + 2][ci * ds.size() + di];
+        }
+        beta[i + 1][bi * cs.size() + ci] = sum;
+      }
+    }
+    normalize(beta[i + 1]);
+  }
+
+  for (int i = 0; i < n; i++) {
+    vector<int> const& bs = possible[i + 1];
+    vector<int> const& cs = possible[i + 2];
+    double* row = &posteriors[(size_t)i * n_tags_];
+    double sum = 0;
+    for (size_t bi = 0; bi < bs.size(); bi++) {
+      for (size_t ci = 0; ci < cs.size(); ci++) {
+        double p = alpha[i + 1][bi * cs.size() + ci] *
+                   beta[i + 1][bi * cs.size() + ci];
+        row[cs[ci]] += p;
+        sum += p;
+      }
+    }
+    if (sum > 0) {
+      for (int c : cs) row[c] /= sum;
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef POS_TAGGER_H
+#define POS_TAGGER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+// Second order hidden Markov model over POS-tags:
+//   P(t_1..t_n, w_1..w_n) = prod_i P(t_i | t_i-2, t_i-1) P(w_i | t_i)
+// The transitions are trigram, bigram and unigram relative frequencies,
+// mixed with weights found by deleted interpolation (as in the TnT tagger).
+// The tagger holds no lexicon: callers pass the emission log scores
+// log P(w_i | t) per position, e.g. the POS-tag row of a chart, so tagger
+// and parser agree on the words and their signatures.
+//
+// Both algorithms only visit the tags with a finite emission score, so a
+// sentence costs O(n k^3) for k tags per word instead of O(n T^3).
+class TrigramTagger {
+ public:
+  TrigramTagger() : n_tags_(0) { ; }
+  // tags: the tag set, trigram_counts: how often each tag trigram was
+  // seen, with "" for the sentence boundary, e.g. {"", "", "DET"} for a
+  // sentence that starts with DET and {"NC", "PONCT", ""} for one that
+  // ends with NC PONCT (see RuleCounts). Trigrams with tags that are not
+  // in the tag set are ignored.
+  TrigramTagger(vector<string> const& tags,
+                map<vector<string>, double> const& trigram_counts);
+
+  bool empty() const { return n_tags_ == 0; }
+  int num_tags() const { return n_tags_; }
+  vector<string> const& tags() const { return tags_; }
+
+  // emissions: n x num_tags() log scores, -infinity for impossible tags.
+  // Most likely tag sequence, empty if there is none.
+  void Viterbi(float const* emissions, int n, vector<int>& tags) const;
+  // Posterior probability of every tag at every position (forward-backward),
+  // n x num_tags(). Positions without a possible tag are all 0.
+  void Posteriors(float const* emissions, int n,
+                  vector<double>& posteriors) const;
+
+ private:
+  vector<string> tags_;
+  int n_tags_;
+  // log P(c | a, b) at (a * (n_tags_ + 1) + b) * (n_tags_ + 1) + c.
+  // Tag id n_tags_ is the sentence boundary: before the first tag (a, b)
+  // and after the last one (c).
+  vector<float> log_transitions_;
+
+  float LogTransition(int a, int b, int c) const {
+    return log_transitions_[((size_t)a * (n_tags_ + 1) + b) * (n_tags_ + 1) +
+                            c];
+  }
+  // Tags with a finite emission score per position, with boundary
+  // positions -2 and -1 in front
+  void PossibleTags(float const* emissions, int n,
+                    vector<vector<int> >& possible) const;
+};
+
+#endif
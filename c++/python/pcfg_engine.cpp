@@ -0,0 +1,415 @@
+/**
+ * Python bindings of the C++ parser (CPython API).
+ *
+ *   import pcfg_engine
+ *   grammar = pcfg_engine.train(treebank_lines)   # or pcfg_engine.load(path)
+ *   tree, log_prob, partial = grammar.parse("Le chat dort .")
+ *   grammar.parse_lattice([[("chat", 0.0), ("chats", -1.0)], ...])
+ *   grammar.parse_batch(list_of_token_lists, threads=4)
+ *
+ * Trees are returned in the treebank bracket format ("( (SENT ...))") or,
+ * with format="tuple", as nested tuples ("SENT", ("NP", ("DET", "le")), ..),
+ * both without the normalization dummies.
+ * The GIL is released while training and parsing, so Python threads parse
+ * in parallel. parse_batch schedules its sentences with BatchParser
+ * (longest first, long sentences split into stealable tiles).
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "batch_parser.h"
+#include "compact_grammar.h"
+#include "dense_parser.h"
+#include "indexed_grammar.h"
+#include "pcfg.h"
+#include "tokenizer.h"
+#include "tree.h"
+#include "tree_writer.h"
+
+using std::string;
+using std::vector;
+
+typedef vector<vector<pair<string, double> > > Lattice;
+
+typedef struct {
+  PyObject_HEAD
+  IndexedGrammar* grammar;
+  Tokenizer* tokenizer;
+} GrammarObject;
+
+static PyTypeObject GrammarType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static void Grammar_dealloc(GrammarObject* self) {
+  delete self->tokenizer;
+  delete self->grammar;
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+// Takes ownership of grammar
+static PyObject* NewGrammar(IndexedGrammar* grammar) {
+  GrammarObject* self =
+      (GrammarObject*)GrammarType.tp_alloc(&GrammarType, 0);
+  if (self == NULL) {
+    delete grammar;
+    return NULL;
+  }
+  self->grammar = grammar;
+  set<string> words(grammar->words_.begin(), grammar->words_.end());
+  self->tokenizer = new Tokenizer(words);
+  return (PyObject*)self;
+}
+
+// ---- Conversions ----
+
+static bool ToString(PyObject* object, string& s) {
+  Py_ssize_t size;
+  char const* data = PyUnicode_AsUTF8AndSize(object, &size);
+  if (data == NULL) return false;
+  s.assign(data, size);
+  return true;
+}
+
+// A sentence is either a str (tokenized with the grammar's tokenizer) or a
+// sequence of str
+static bool ToTokens(GrammarObject* self, PyObject* object,
+                     vector<string>& tokens) {
+  tokens.clear();
+  if (PyUnicode_Check(object)) {
+    string text;
+    if (!ToString(object, text)) return false;
+    vector<string_view> views;
+    self->tokenizer->Tokenize(text, views);
+    tokens.assign(views.begin(), views.end());
+    return true;
+  }
+  PyObject* sequence = PySequence_Fast(object, "tokens must be a sequence");
+  if (sequence == NULL) return false;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(sequence);
+  tokens.resize(n);
+  for (Py_ssize_t i = 0; i < n; i++) {
+    if (!ToString(PySequence_Fast_GET_ITEM(sequence, i), tokens[i])) {
+      Py_DECREF(sequence);
+      return false;
+    }
+  }
+  Py_DECREF(sequence);
+  return true;
+}
+
+// [[(word, log weight), ...], ...]
+static bool ToLattice(PyObject* object, Lattice& lattice) {
+  PyObject* positions = PySequence_Fast(object, "lattice must be a sequence");
+  if (positions == NULL) return false;
+  bool ok = true;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(positions);
+  lattice.resize(n);
+  for (Py_ssize_t i = 0; i < n && ok; i++) {
+    PyObject* candidates = PySequence_Fast(
+        PySequence_Fast_GET_ITEM(positions, i),
+        "lattice positions must be sequences of (word, log weight)");
+    if (candidates == NULL) {
+      ok = false;
+      break;
+    }
+    for (Py_ssize_t j = 0; j < PySequence_Fast_GET_SIZE(candidates); j++) {
+      char const* word;
+      Py_ssize_t size;
+      double weight;
+      if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(candidates, j), "s#d",
+                            &word, &size, &weight)) {
+        ok = false;
+        break;
+      }
+      lattice[i].push_back(std::make_pair(string(word, size), weight));
+    }
+    Py_DECREF(candidates);
+  }
+  Py_DECREF(positions);
+  return ok;
+}
+
+static PyObject* TreeToTuple(Tree<string>* t) {
+  if (t->IsLeaf()) {
+    return PyUnicode_FromStringAndSize(t->value_.data(), t->value_.size());
+  }
+  PyObject* tuple = PyTuple_New(t->num_children() + 1);
+  if (tuple == NULL) return NULL;
+  PyTuple_SET_ITEM(tuple, 0, PyUnicode_FromStringAndSize(t->value_.data(),
+                                                         t->value_.size()));
+  for (int i = 0; i < t->num_children(); i++) {
+    PyObject* child = TreeToTuple(t->children_[i].get());
+    if (child == NULL) {
+      Py_DECREF(tuple);
+      return NULL;
+    }
+    PyTuple_SET_ITEM(tuple, i + 1, child);
+  }
+  return tuple;
+}
+
+// (tree, log probability, partial) or None
+static PyObject* ResultToPython(pTreeProb const& result, bool partial,
+                                bool as_tuple) {
+  if (result.first == nullptr) Py_RETURN_NONE;
+  PyObject* tree;
+  if (as_tuple) {
+    DenormalizeTree(result.first.get());
+    tree = TreeToTuple(result.first.get());
+  } else {
+    string s = "( (";
+    WriteBracketString(result.first.get(), s, true);
+    s += "))";
+    tree = PyUnicode_FromStringAndSize(s.data(), s.size());
+  }
+  if (tree == NULL) return NULL;
+  return Py_BuildValue("(NdO)", tree, result.second,
+                       partial ? Py_True : Py_False);
+}
+
+static bool IsTupleFormat(char const* format) {
+  return format != NULL && string(format) == "tuple";
+}
+
+// ---- Grammar methods ----
+
+static PyObject* Grammar_parse(GrammarObject* self, PyObject* args,
+                               PyObject* kwargs) {
+  static char const* keywords[] = {"tokens", "format", "max_ms", NULL};
+  PyObject* tokens_object;
+  char const* format = NULL;
+  double max_ms = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sd", (char**)keywords,
+                                   &tokens_object, &format, &max_ms)) {
+    return NULL;
+  }
+  vector<string> tokens;
+  if (!ToTokens(self, tokens_object, tokens)) return NULL;
+  pTreeProb result;
+  bool partial;
+  Py_BEGIN_ALLOW_THREADS
+  DenseParser parser(*self->grammar);
+  parser.SetBudget(max_ms / 1000, 0);
+  result = parser.Parse(tokens);
+  partial = parser.partial();
+  Py_END_ALLOW_THREADS
+  return ResultToPython(result, partial, IsTupleFormat(format));
+}
+
+static PyObject* Grammar_parse_lattice(GrammarObject* self, PyObject* args,
+                                       PyObject* kwargs) {
+  static char const* keywords[] = {"lattice", "format", "max_ms", NULL};
+  PyObject* lattice_object;
+  char const* format = NULL;
+  double max_ms = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sd", (char**)keywords,
+                                   &lattice_object, &format, &max_ms)) {
+    return NULL;
+  }
+  Lattice lattice;
+  if (!ToLattice(lattice_object, lattice)) return NULL;
+  pTreeProb result;
+  bool partial;
+  Py_BEGIN_ALLOW_THREADS
+  DenseParser parser(*self->grammar);
+  parser.SetBudget(max_ms / 1000, 0);
+  result = parser.Parse(lattice);
+  partial = parser.partial();
+  Py_END_ALLOW_THREADS
+  return ResultToPython(result, partial, IsTupleFormat(format));
+}
+
+static PyObject* Grammar_parse_batch(GrammarObject* self, PyObject* args,
+                                     PyObject* kwargs) {
+  static char const* keywords[] = {"sentences", "threads", "format", "max_ms",
+                                   NULL};
+  PyObject* sentences_object;
+  int n_threads = 0;
+  char const* format = NULL;
+  double max_ms = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|isd", (char**)keywords,
+                                   &sentences_object, &n_threads, &format,
+                                   &max_ms)) {
+    return NULL;
+  }
+  PyObject* sequence =
+      PySequence_Fast(sentences_object, "sentences must be a sequence");
+  if (sequence == NULL) return NULL;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(sequence);
+  vector<vector<string> > sentences(n);
+  for (Py_ssize_t i = 0; i < n; i++) {
+    if (!ToTokens(self, PySequence_Fast_GET_ITEM(sequence, i), sentences[i])) {
+      Py_DECREF(sequence);
+      return NULL;
+    }
+  }
+  Py_DECREF(sequence);
+
+  vector<pTreeProb> results;
+  vector<char> partial;
+  Py_BEGIN_ALLOW_THREADS
+  BatchOptions options;
+  options.threads_ = n_threads;
+  options.max_seconds_ = max_ms / 1000;
+  BatchParser batch_parser(*self->grammar, options);
+  batch_parser.Parse(sentences, results, &partial);
+  Py_END_ALLOW_THREADS
+
+  PyObject* list = PyList_New(n);
+  if (list == NULL) return NULL;
+  for (Py_ssize_t i = 0; i < n; i++) {
+    PyObject* item = ResultToPython(results[i], partial[i],
+                                    IsTupleFormat(format));
+    if (item == NULL) {
+      Py_DECREF(list);
+      return NULL;
+    }
+    PyList_SET_ITEM(list, i, item);
+  }
+  return list;
+}
+
+static PyObject* Grammar_tokenize(GrammarObject* self, PyObject* args) {
+  char const* text;
+  Py_ssize_t size;
+  if (!PyArg_ParseTuple(args, "s#", &text, &size)) return NULL;
+  vector<string_view> views;
+  self->tokenizer->Tokenize(string_view(text, size), views);
+  PyObject* list = PyList_New(views.size());
+  if (list == NULL) return NULL;
+  for (size_t i = 0; i < views.size(); i++) {
+    PyList_SET_ITEM(list, i,
+                    PyUnicode_FromStringAndSize(views[i].data(),
+                                                views[i].size()));
+  }
+  return list;
+}
+
+static PyObject* Grammar_save(GrammarObject* self, PyObject* args) {
+  char const* path;
+  if (!PyArg_ParseTuple(args, "s", &path)) return NULL;
+  CompactGrammar compact(*self->grammar, PRECISION_FLOAT);
+  if (!compact.Save(path)) {
+    return PyErr_Format(PyExc_IOError, "could not write %s", path);
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* Grammar_num_non_terms(GrammarObject* self, void*) {
+  return PyLong_FromLong(self->grammar->num_non_terms());
+}
+
+static PyObject* Grammar_num_words(GrammarObject* self, void*) {
+  return PyLong_FromLong(self->grammar->num_words());
+}
+
+static PyMethodDef Grammar_methods[] = {
+    {"parse", (PyCFunction)(void (*)(void))Grammar_parse,
+     METH_VARARGS | METH_KEYWORDS,
+     "parse(tokens, format='bracket', max_ms=0) -> (tree, log_prob, partial)"
+     " or None\ntokens is a list of str or a str to tokenize."},
+    {"parse_lattice", (PyCFunction)(void (*)(void))Grammar_parse_lattice,
+     METH_VARARGS | METH_KEYWORDS,
+     "parse_lattice(lattice, format='bracket', max_ms=0)\nlattice is a list "
+     "of [(word, log weight), ...] per position."},
+    {"parse_batch", (PyCFunction)(void (*)(void))Grammar_parse_batch,
+     METH_VARARGS | METH_KEYWORDS,
+     "parse_batch(sentences, threads=0, format='bracket', max_ms=0) -> list\n"
+     "threads=0 uses all cores."},
+    {"tokenize", (PyCFunction)Grammar_tokenize, METH_VARARGS,
+     "tokenize(text) -> list of tokens"},
+    {"save", (PyCFunction)Grammar_save, METH_VARARGS,
+     "save(path), readable with pcfg_engine.load"},
+    {NULL, NULL, 0, NULL}};
+
+static PyGetSetDef Grammar_getset[] = {
+    {"num_non_terms", (getter)Grammar_num_non_terms, NULL, NULL, NULL},
+    {"num_words", (getter)Grammar_num_words, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
+// ---- Module functions ----
+
+static PyObject* Train(PyObject*, PyObject* args, PyObject* kwargs) {
+  static char const* keywords[] = {"lines", "horizontal_order",
+                                   "vertical_order", NULL};
+  PyObject* lines_object;
+  int horizontal_order = -1;
+  int vertical_order = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii", (char**)keywords,
+                                   &lines_object, &horizontal_order,
+                                   &vertical_order)) {
+    return NULL;
+  }
+  vector<string> lines;
+  PyObject* sequence = PySequence_Fast(lines_object, "lines must be a sequence");
+  if (sequence == NULL) return NULL;
+  lines.resize(PySequence_Fast_GET_SIZE(sequence));
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (!ToString(PySequence_Fast_GET_ITEM(sequence, i), lines[i])) {
+      Py_DECREF(sequence);
+      return NULL;
+    }
+  }
+  Py_DECREF(sequence);
+
+  IndexedGrammar* grammar;
+  Py_BEGIN_ALLOW_THREADS
+  RuleCounts counts;
+  for (string const& line : lines) {
+    shared_ptr<Tree<string> > t = ParseTree(line);
+    if (!t->HasChildren()) continue;
+    NormalizeTree(t.get(), horizontal_order, vertical_order);
+    counts.AddTree(t.get());
+  }
+  grammar = new IndexedGrammar(EstimatePCFG(counts));
+  Py_END_ALLOW_THREADS
+  return NewGrammar(grammar);
+}
+
+static PyObject* Load(PyObject*, PyObject* args) {
+  char const* path;
+  if (!PyArg_ParseTuple(args, "s", &path)) return NULL;
+  CompactGrammar compact;
+  if (!compact.Load(path)) {
+    return PyErr_Format(PyExc_IOError, "could not read %s", path);
+  }
+  return NewGrammar(new IndexedGrammar(compact.Expand()));
+}
+
+static PyMethodDef module_methods[] = {
+    {"train", (PyCFunction)(void (*)(void))Train, METH_VARARGS | METH_KEYWORDS,
+     "train(lines, horizontal_order=-1, vertical_order=1) -> Grammar\n"
+     "lines are trees in the Sequoia bracket format."},
+    {"load", (PyCFunction)Load, METH_VARARGS,
+     "load(path) -> Grammar saved with Grammar.save"},
+    {NULL, NULL, 0, NULL}};
+
+static PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "pcfg_engine",
+    "C++ PCFG parser (dense CYK with SIMD kernels)", -1, module_methods};
+
+PyMODINIT_FUNC PyInit_pcfg_engine(void) {
+  GrammarType.tp_name = "pcfg_engine.Grammar";
+  GrammarType.tp_basicsize = sizeof(GrammarObject);
+  GrammarType.tp_flags = Py_TPFLAGS_DEFAULT;
+  GrammarType.tp_doc = "Trained grammar, immutable and shareable by threads";
+  GrammarType.tp_dealloc = (destructor)Grammar_dealloc;
+  GrammarType.tp_methods = Grammar_methods;
+  GrammarType.tp_getset = Grammar_getset;
+  if (PyType_Ready(&GrammarType) < 0) return NULL;
+
+  PyObject* module = PyModule_Create(&module_def);
+  if (module == NULL) return NULL;
+  Py_INCREF(&GrammarType);
+  if (PyModule_AddObject(module, "Grammar", (PyObject*)&GrammarType) < 0) {
+    Py_DECREF(&GrammarType);
+    Py_DECREF(module);
+    return NULL;
+  }
+  return module;
+}
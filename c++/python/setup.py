@@ -0,0 +1,25 @@
+# Builds the pcfg_engine extension module from the C++ sources:
+#   cd c++/python && python setup.py build_ext --inplace
+import glob
+import os
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+cpp_dir = os.path.dirname(here)
+sources = [os.path.relpath(p, here)
+           for p in sorted(glob.glob(os.path.join(cpp_dir, '*.cpp')))
+           if os.path.basename(p) != 'main.cpp']
+
+setup(
+    name='pcfg_engine',
+    version='0.1',
+    ext_modules=[Extension(
+        'pcfg_engine',
+        sources=['pcfg_engine.cpp'] + sources,
+        include_dirs=[os.path.relpath(cpp_dir, here)],
+        extra_compile_args=['-std=c++17', '-O3', '-pthread'],
+        extra_link_args=['-pthread'],
+        language='c++',
+    )],
+)
@@ -0,0 +1,34 @@
+#ifndef SYMBOL_SET_H
+#define SYMBOL_SET_H
+
+#include <stdint.h>
+#include <vector>
+
+using std::vector;
+
+// Fixed size set of symbol ids stored as a bitset.
+// Used to rule out rule applications with a few word-wise ANDs before any
+// symbol lookup or tree construction happens.
+// The loops over the words are simple enough for the compiler to vectorize.
+class SymbolSet {
+ public:
+  SymbolSet() { ; }
+  SymbolSet(int n_symbols) : words_((n_symbols + 63) / 64, 0) { ; }
+
+  void Insert(int id) { words_[id >> 6] |= uint64_t(1) << (id & 63); }
+  bool Contains(int id) const {
+    return (words_[id >> 6] >> (id & 63)) & 1;
+  }
+  size_t MemoryBytes() const { return words_.capacity() * sizeof(uint64_t); }
+  // Tests whether this and other have at least one symbol in common
+  bool Intersects(SymbolSet const& other) const {
+    uint64_t any = 0;
+    for (size_t i = 0; i < words_.size(); i++) any |= words_[i] & other.words_[i];
+    return any != 0;
+  }
+
+ private:
+  vector<uint64_t> words_;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "tokenizer.h"
+
+#include <algorithm>
+
+static const string_view kLeftBracket = "-LRB-";
+static const string_view kRightBracket = "-RRB-";
+static const string_view kApostrophe = "'";
+// U+2019 in UTF-8
+static const string_view kTypographicApostrophe = "\xE2\x80\x99";
+
+static bool IsTypographicApostrophe(string_view text, size_t i) {
+  return text.substr(i, kTypographicApostrophe.size()) ==
+         kTypographicApostrophe;
+}
+
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Characters that form tokens of their own. '-' and '\'' only do so at
+// the start of a word.
+static bool IsPunctuation(char c) {
+  switch (c) {
+    case ',': case '.': case ';': case ':': case '!': case '?':
+    case '"': case '(': case ')': case '[': case ']': case '/':
+    case '^': case '-': case '\'':
+      return true;
+    default:
+      return false;
+  }
+}
+
+Tokenizer::Tokenizer(set<string> const& lexicon) {
+  for (string const& word : lexicon) {
+    if (word.size() > 1 && word.find('_') != string::npos) {
+      multi_word_texts_.push_back(word);
+    }
+    if (word.size() > 1 && word.back() == '.') {
+      abbreviations_.insert(word);
+    }
+    if (word.size() > 1 && word.back() == '\'') {
+      elisions_[word.substr(0, word.size() - 1)] = word;
+    }
+  }
+  // multi_word_texts_ does not change any more, views stay valid
+  for (string const& word : multi_word_texts_) {
+    MultiWordUnit unit;
+    unit.text_ = word;
+    size_t start = 0;
+    while (start <= word.size()) {
+      size_t end = std::min(word.find('_', start), word.size());
+      if (end > start) {
+        unit.parts_.push_back(string_view(word).substr(start, end - start));
+        if (word[end - 1] == '\'') {
+          elisions_[word.substr(start, end - 1 - start)] =
+              word.substr(start, end - start);
+        }
+      }
+      start = end + 1;
+    }
+    if (unit.parts_.size() < 2) continue;
+    multi_word_units_[unit.parts_[0]].push_back(unit);
+  }
+  for (auto& it : multi_word_units_) {
+    std::stable_sort(it.second.begin(), it.second.end(),
+                     [](MultiWordUnit const& a, MultiWordUnit const& b) {
+                       return a.parts_.size() > b.parts_.size();
+                     });
+  }
+}
+
+// Returns the end of the word starting at text[start]
+size_t Tokenizer::ReadWord(string_view text, size_t start) const {
+  size_t i = start;
+  while (i < text.size() && !IsSpace(text[i])) {
+    char c = text[i];
+    if (c == '\'') {
+      // Elision, the apostrophe belongs to the word
+      return i + 1;
+    }
+    if (IsTypographicApostrophe(text, i)) {
+      return i + kTypographicApostrophe.size();
+    }
+    if (c == '-') {
+      // Compounds like "Dammarie-sur-Saulx"
+      i++;
+      continue;
+    }
+    if ((c == ',' || c == '.') && i > start && IsDigit(text[i - 1]) &&
+        i + 1 < text.size() && IsDigit(text[i + 1])) {
+      // Numbers like "3,5" or "1.000"
+      i++;
+      continue;
+    }
+    if (c == '.' && abbreviations_.count(text.substr(start, i + 1 - start))) {
+      return i + 1;
+    }
+    if (IsPunctuation(c)) break;
+    i++;
+  }
+  return i;
+}
+
+void Tokenizer::Tokenize(string_view text, vector<string_view>& tokens) const {
+  tokens.clear();
+  size_t i = 0;
+  while (i < text.size()) {
+    char c = text[i];
+    if (IsSpace(c)) {
+      i++;
+    } else if (c == '(') {
+      tokens.push_back(kLeftBracket);
+      i++;
+    } else if (c == ')') {
+      tokens.push_back(kRightBracket);
+      i++;
+    } else if (c == '.') {
+      // "." or "..."
+      size_t end = i;
+      while (end < text.size() && text[end] == '.') end++;
+      tokens.push_back(text.substr(i, end - i));
+      i = end;
+    } else if (IsPunctuation(c)) {
+      tokens.push_back(text.substr(i, 1));
+      i++;
+    } else if (IsTypographicApostrophe(text, i)) {
+      tokens.push_back(kApostrophe);
+      i += kTypographicApostrophe.size();
+    } else {
+      size_t end = ReadWord(text, i);
+      string_view word = text.substr(i, end - i);
+      size_t stem = word.size() - kTypographicApostrophe.size();
+      if (word.size() > kTypographicApostrophe.size() &&
+          IsTypographicApostrophe(word, stem)) {
+        // Spelled with '\'' if the lexicon knows the word, unknown words
+        // are left as they are
+        auto it = elisions_.find(word.substr(0, stem));
+        if (it != elisions_.end()) word = it->second;
+      }
+      tokens.push_back(word);
+      i = end;
+    }
+  }
+  MatchMultiWordUnits(tokens);
+}
+
+// Whether a sentence can start with c. Non-ASCII bytes are accepted since
+// capital letters with accents ("À", "É") are multi-byte in UTF-8.
+static bool CanStartSentence(char c) {
+  return (c >= 'A' && c <= 'Z') || IsDigit(c) || c == '"' || c == '(' ||
+         c == '-' || (unsigned char)c >= 0x80;
+}
+
+void Tokenizer::SplitSentences(string_view text,
+                               vector<string_view>& sentences) const {
+  sentences.clear();
+  size_t start = 0;
+  size_t i = 0;
+  while (i < text.size()) {
+    char c = text[i];
+    if (c != '.' && c != '!' && c != '?') {
+      i++;
+      continue;
+    }
+    size_t end = i;
+    while (end < text.size() &&
+           (text[end] == '.' || text[end] == '!' || text[end] == '?')) {
+      end++;
+    }
+    while (end < text.size() && (text[end] == '"' || text[end] == ')')) end++;
+    size_t next = end;
+    while (next < text.size() && IsSpace(text[next])) next++;
+    bool boundary = next > end && next < text.size() &&
+                    CanStartSentence(text[next]);
+    if (boundary && c == '.' && end == i + 1) {
+      size_t word_start = i;
+      while (word_start > start && !IsSpace(text[word_start - 1])) {
+        word_start--;
+      }
+      string_view word = text.substr(word_start, i + 1 - word_start);
+      bool initial = word.size() == 2 && word[0] >= 'A' && word[0] <= 'Z';
+      if (initial || abbreviations_.count(word)) boundary = false;
+    }
+    if (boundary) {
+      sentences.push_back(text.substr(start, end - start));
+      start = next;
+    }
+    i = next;
+  }
+  while (start < text.size() && IsSpace(text[start])) start++;
+  if (start < text.size()) sentences.push_back(text.substr(start));
+}
+
+// Replaces token sequences by multi-word units in place (the output never
+// gets ahead of the input)
+void Tokenizer::MatchMultiWordUnits(vector<string_view>& tokens) const {
+  size_t out = 0;
+  size_t i = 0;
+  while (i < tokens.size()) {
+    size_t n_parts = 1;
+    string_view token = tokens[i];
+    auto it = multi_word_units_.find(tokens[i]);
+    if (it != multi_word_units_.end()) {
+      for (MultiWordUnit const& unit : it->second) {
+        size_t n = unit.parts_.size();
+        if (i + n > tokens.size()) continue;
+        if (std::equal(unit.parts_.begin() + 1, unit.parts_.end(),
+                       tokens.begin() + i + 1)) {
+          n_parts = n;
+          token = unit.text_;
+          break;
+        }
+      }
+    }
+    tokens[out++] = token;
+    i += n_parts;
+  }
+  tokens.resize(out);
+}
@@ -0,0 +1,69 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::map;
+using std::set;
+using std::string;
+using std::string_view;
+using std::vector;
+
+// Splits raw French text into tokens as they appear in the Sequoia treebank:
+// - elided words keep their apostrophe and are split from the next word:
+//   "l'imprimerie" --> "l'", "imprimerie". The typographic apostrophe
+//   (U+2019) is treated the same, and elided words of the lexicon are
+//   spelled with the ASCII one as in the treebank: "qu’une" --> "qu'", "une"
+// - punctuation is split from words, except inside numbers ("3,5") and
+//   abbreviations known to the lexicon ("M.", "etc.")
+// - brackets become -LRB- / -RRB-
+// - multi-word units of the lexicon are matched greedily (longest first):
+//   "en faveur de" --> "en_faveur_de", "aujourd'hui" --> "aujourd'_hui"
+//
+// Tokens are string_views into the caller's text, or into the tokenizer's
+// own strings for multi-word units, brackets and elided words. Tokenizing does not
+// allocate once the output vector has grown to the sentence length.
+// Tokenize is const and can be called from several threads at once.
+class Tokenizer {
+ public:
+  Tokenizer(set<string> const& lexicon);
+  // multi_word_units_ and the tokens handed out hold views into this
+  // object's strings (short strings do not keep their address when moved),
+  // so a Tokenizer stays where it was built
+  Tokenizer(Tokenizer const&) = delete;
+  Tokenizer& operator=(Tokenizer const&) = delete;
+
+  // Replaces the content of tokens by the tokens of text
+  void Tokenize(string_view text, vector<string_view>& tokens) const;
+  // Replaces the content of sentences by the sentences of text (views into
+  // text). A sentence ends after '.', '!', '?' or "..." (and closing quotes
+  // or brackets) that is followed by a capital letter, a digit or an
+  // opening quote. Abbreviations of the lexicon and initials ("J.") do not
+  // end sentences.
+  void SplitSentences(string_view text, vector<string_view>& sentences) const;
+
+ private:
+  struct MultiWordUnit {
+    string_view text_;
+    vector<string_view> parts_;
+  };
+
+  // Underscore forms of the lexicon; the views below point into them
+  vector<string> multi_word_texts_;
+  // Multi-word units by their first part, longest first
+  map<string_view, vector<MultiWordUnit>, std::less<> > multi_word_units_;
+  // Words of the lexicon that end with a '.'
+  set<string, std::less<> > abbreviations_;
+  // Words of the lexicon (and parts of multi-word units) that end with a
+  // '\'', by their text without it: "qu" --> "qu'"
+  map<string, string, std::less<> > elisions_;
+
+  size_t ReadWord(string_view text, size_t start) const;
+  void MatchMultiWordUnits(vector<string_view>& tokens) const;
+};
+
+#endif
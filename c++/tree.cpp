@@ -1,24 +1,32 @@
 #include "tree.h"
+#include "tree_writer.h"
 #include "utils.h"
 
 #include <string>
 
 template <>
 string Tree<string>::print(int level) {
-  string s(2 + 2 * level, ' ');
-  if (!HasChildren()) {
-    return s + value_;
-  }
-  if (IsPreterminal()) {
-    return s + value_ + " -> " + children_[0]->value_;
-  }
-
-  s = s + value_ + "\n";
-  for (int i = 0; i < children_.size(); i++) {
-    s += children_[i]->print(level + 1);
-    if (i < children_.size() - 1) {
+  // DFS with explicit stack (node, level), one line per node
+  string s;
+  stack<pair<Tree<string>*, int> > stack;
+  stack.push(pair<Tree<string>*, int>(this, level));
+  while (!stack.empty()) {
+    Tree<string>* t = stack.top().first;
+    int l = stack.top().second;
+    stack.pop();
+    if (!s.empty()) {
       s += "\n";
     }
+    s.append(2 + 2 * l, ' ');
+    s += t->value_;
+    if (t->IsPreterminal()) {
+      s += " -> ";
+      s += t->children_[0]->value_;
+      continue;
+    }
+    for (int i = t->num_children() - 1; i >= 0; i--) {
+      stack.push(pair<Tree<string>*, int>(t->children_[i].get(), l + 1));
+    }
   }
 
   if (level == 0) {
@@ -30,17 +38,8 @@ string Tree<string>::print(int level) {
 
 template <>
 string Tree<string>::BracketString() {
-  if (!HasChildren()) {
-    return value_;
-  }
-  if (IsPreterminal()) {
-    return value_ + " " + children_[0]->value_;
-  }
-  string s = value_;
-  for (shared_ptr<Tree<string> > c : children_) {
-    s += " (" + c->BracketString() + ")";
-  }
-
+  string s;
+  WriteBracketString(this, s);
   return s;
 }
 
@@ -58,17 +57,22 @@ void ApplyTermRule(Tree<string>* t) {
   }
 }
 
-void ApplyBinarizeRule(Tree<string>* t) {
+void ApplyBinarizeRule(Tree<string>* t, int horizontal_order) {
   vector<shared_ptr<Tree<string> > >& children = t->children_;
 
   // Construct dummy
   string dummy_value = "";
   auto dummy = make_shared<Tree<string> >(dummy_value, t->weak_from_this());
   for (int i = 1; i < children.size(); i++) {
-    if (i > 1) {
-      dummy_value += "&";
+    bool named = horizontal_order < 0 || i <= horizontal_order;
+    if (named) {
+      if (i > 1) {
+        dummy_value += "&";
+      }
+      dummy_value += children[i]->value_;
+    } else if (i == horizontal_order + 1) {
+      dummy_value += "&...";
     }
-    dummy_value += children[i]->value_;
     // Attach child to dummy and increase child's reference counter
     dummy->AddChild(children[i]);
   }
@@ -91,7 +95,36 @@ void ApplyUnitRule(Tree<string>* t) {
   }
 }
 
-void NormalizeTree(Tree<string>* t) {
+void ApplyParentAnnotation(Tree<string>* t, int vertical_order) {
+  if (vertical_order <= 1) return;
+  // DFS, every entry holds a node and the labels of its ancestors
+  // (closest first) as they were before annotation
+  stack<pair<Tree<string>*, vector<string> > > stack;
+  stack.push(pair<Tree<string>*, vector<string> >(t, vector<string>()));
+  while (!stack.empty()) {
+    Tree<string>* node = stack.top().first;
+    vector<string> ancestors = stack.top().second;
+    stack.pop();
+    if (node->IsTerminal() || node->IsPreterminal()) continue;
+
+    vector<string> child_ancestors{node->value_};
+    for (size_t i = 0; i < ancestors.size() && i + 2 < (size_t)vertical_order;
+         i++) {
+      child_ancestors.push_back(ancestors[i]);
+    }
+    for (size_t i = 0; i < ancestors.size() && i + 1 < (size_t)vertical_order;
+         i++) {
+      node->value_ += "^" + ancestors[i];
+    }
+    for (shared_ptr<Tree<string> > c : node->children_) {
+      stack.push(pair<Tree<string>*, vector<string> >(c.get(),
+                                                      child_ancestors));
+    }
+  }
+}
+
+void NormalizeTree(Tree<string>* t, int horizontal_order, int vertical_order) {
+  ApplyParentAnnotation(t, vertical_order);
   stack<Tree<string>*> stack_to_normalize;
 
   // iterate through the tree and normalize the branchings
@@ -141,13 +174,55 @@ void NormalizeTree(Tree<string>* t) {
       } else {
         // > 2 Nonterminal children
         // BINARIZE Rule
-        ApplyBinarizeRule(t);
+        ApplyBinarizeRule(t, horizontal_order);
         stack_to_normalize.push(t);
       }
     }
   }
 }
 
+bool IsNormalizationDummy(Tree<string>* t) {
+  string const& value = t->value_;
+  if (value.find('&') != string::npos) return true;
+  return value.size() > 1 && value[0] == '_' && t->num_children() == 1 &&
+         t->children_[0]->IsPreterminal();
+}
+
+void DenormalizeTree(Tree<string>* t) {
+  stack<Tree<string>*> stack_to_denormalize;
+  stack_to_denormalize.push(t);
+  while (!stack_to_denormalize.empty()) {
+    Tree<string>* t = stack_to_denormalize.top();
+    stack_to_denormalize.pop();
+    if (t->IsTerminal()) continue;
+
+    size_t annotation = t->value_.find('^');
+    if (annotation != string::npos) t->value_.resize(annotation);
+    if (t->IsPreterminal()) continue;
+
+    // Splice dummies out. Nested dummies (A&B&C -> A, B&C) are expanded
+    // further as they are pushed back to the front of the worklist.
+    vector<shared_ptr<Tree<string> > > children;
+    vector<shared_ptr<Tree<string> > > worklist(t->children_.rbegin(),
+                                                t->children_.rend());
+    while (!worklist.empty()) {
+      shared_ptr<Tree<string> > c = worklist.back();
+      worklist.pop_back();
+      if (IsNormalizationDummy(c.get())) {
+        worklist.insert(worklist.end(), c->children_.rbegin(),
+                        c->children_.rend());
+        continue;
+      }
+      c->parent_ = t->weak_from_this();
+      children.push_back(c);
+    }
+    t->children_ = children;
+    for (shared_ptr<Tree<string> > c : t->children_) {
+      stack_to_denormalize.push(c.get());
+    }
+  }
+}
+
 shared_ptr<Tree<string> > ParseTree(string s) {
   auto root = make_shared<Tree<string> >("");
 
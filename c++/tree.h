@@ -105,8 +105,13 @@ void ApplyTermRule(Tree<string>* t);
  *      C1  C2  C3         C1   C2&C3
  *                               / \ 
  *                              C2  C3
+ *
+ * horizontal_order: Horizontal markovization. The dummy is named after at
+ * most that many of the merged children, followed by "&..." if there are
+ * more of them, e.g. with order 1 the dummy above becomes "C2&...".
+ * A negative order names the dummy after all merged children.
 */
-void ApplyBinarizeRule(Tree<string>* t);
+void ApplyBinarizeRule(Tree<string>* t, int horizontal_order = -1);
 
 /**
  * Assumes t has a single child which is not a leaf.
@@ -117,15 +122,43 @@ void ApplyBinarizeRule(Tree<string>* t);
  */
 void ApplyUnitRule(Tree<string>* t);
 
+/**
+ * Vertical markovization: appends the labels of the order-1 closest
+ * ancestors to the label of every NonTerminal below the root, e.g. with
+ * order 2 an NP under a PP becomes "NP^PP", with order 3 "NP^PP^SENT".
+ * POS-tags and tokens keep their labels.
+ * Order 1 (or less) leaves the tree unchanged.
+ */
+void ApplyParentAnnotation(Tree<string>* t, int vertical_order);
+
 /**
  * Transforms a dependency tree into Chomsky Normal Form
  * i.e. it will later only consist of rules (branchings) of the form:
  * NonTerminal -> [NonTerminal]*
  * NonTerminal -> POS-Tag
  * POS-Tag -> token
+ *
+ * The binarization dummies are named after all the children they merge,
+ * which creates thousands of NonTerminals that are seen only once.
+ * horizontal_order >= 0 bounds the number of children in a dummy's name
+ * (see ApplyBinarizeRule), vertical_order >= 2 annotates NonTerminals with
+ * their ancestors (see ApplyParentAnnotation).
+ */
+void NormalizeTree(Tree<string>* t, int horizontal_order = -1,
+                   int vertical_order = 1);
+
+/**
+ * Tests whether t is a node inserted by NormalizeTree, i.e. a TERM dummy
+ * (_POS above a POS-tag) or a BINARIZE dummy (A&B)
  */
-void NormalizeTree(Tree<string>* t);
+bool IsNormalizationDummy(Tree<string>* t);
 
+/**
+ * Reverts NormalizeTree in place as far as possible: dummies are replaced by
+ * their children and parent annotations are cut off (NP^PP -> NP).
+ * Levels collapsed by the UNIT rule cannot be recovered.
+ */
+void DenormalizeTree(Tree<string>* t);
 
 /**
  * Builds up a tree from a valid bracket expression
@@ -0,0 +1,92 @@
+#include "tree_writer.h"
+
+namespace {
+
+struct StringSink {
+  string& buffer_;
+  void Append(char const* s, size_t n) { buffer_.append(s, n); }
+  void Append(char c) { buffer_.push_back(c); }
+};
+
+struct StreamSink {
+  std::ostream& out_;
+  void Append(char const* s, size_t n) { out_.write(s, n); }
+  void Append(char c) { out_.put(c); }
+};
+
+template <typename Sink>
+void AppendLabel(Sink& sink, string const& label, bool denormalize) {
+  size_t n = label.size();
+  if (denormalize) {
+    size_t annotation = label.find('^');
+    if (annotation != string::npos) n = annotation;
+  }
+  sink.Append(label.data(), n);
+}
+
+// Writes "label", "label token" for preterminals, and for all other nodes
+// only the label (children follow)
+template <typename Sink>
+void AppendNodeHead(Sink& sink, Tree<string>* t, bool denormalize) {
+  if (t->IsLeaf()) {
+    sink.Append(t->value_.data(), t->value_.size());
+    return;
+  }
+  AppendLabel(sink, t->value_, denormalize);
+  if (t->IsPreterminal()) {
+    sink.Append(' ');
+    string const& token = t->children_[0]->value_;
+    sink.Append(token.data(), token.size());
+  }
+}
+
+template <typename Sink>
+void Write(Tree<string>* t, Sink& sink, bool denormalize) {
+  // Explicit DFS stack: node, index of the next child to write and whether
+  // the node itself is skipped (dummy), i.e. has no brackets of its own
+  struct Frame {
+    Tree<string>* node_;
+    int next_child_;
+    bool skipped_;
+  };
+  vector<Frame> stack;
+
+  AppendNodeHead(sink, t, denormalize);
+  if (t->IsLeaf() || t->IsPreterminal()) return;
+  stack.push_back(Frame{t, 0, true});
+
+  while (!stack.empty()) {
+    Frame& frame = stack.back();
+    if (frame.next_child_ == frame.node_->num_children()) {
+      bool skipped = frame.skipped_;
+      stack.pop_back();
+      // The root's brackets are added by the caller (treebank format)
+      if (!skipped) sink.Append(')');
+      continue;
+    }
+    Tree<string>* child = frame.node_->children_[frame.next_child_++].get();
+    if (denormalize && IsNormalizationDummy(child)) {
+      stack.push_back(Frame{child, 0, true});
+      continue;
+    }
+    sink.Append(" (", 2);
+    AppendNodeHead(sink, child, denormalize);
+    if (child->IsLeaf() || child->IsPreterminal()) {
+      sink.Append(')');
+    } else {
+      stack.push_back(Frame{child, 0, false});
+    }
+  }
+}
+
+}  // namespace
+
+void WriteBracketString(Tree<string>* t, string& buffer, bool denormalize) {
+  StringSink sink{buffer};
+  Write(t, sink, denormalize);
+}
+
+void WriteBracketString(Tree<string>* t, std::ostream& out, bool denormalize) {
+  StreamSink sink{out};
+  Write(t, sink, denormalize);
+}
@@ -0,0 +1,28 @@
+#ifndef TREE_WRITER_H
+#define TREE_WRITER_H
+
+#include <ostream>
+#include <string>
+
+#include "tree.h"
+
+using std::string;
+
+// Streaming serializers for constituency trees.
+// Both write t in the format of Tree::BracketString, e.g.
+// "SENT (NP (NPP Gutenberg))", in a single non-recursive pass and without
+// building intermediate strings.
+//
+// denormalize: Undo NormalizeTree on the fly, without copying the tree.
+// TERM dummies (_POS) and BINARIZE dummies (A&B) are left out and their
+// children are written in their place, and parent annotations (NP^PP) are
+// cut off. The root is always written.
+// Levels collapsed by the UNIT rule cannot be recovered.
+
+// Appends t to buffer, so a caller can reuse the buffer's capacity
+void WriteBracketString(Tree<string>* t, string& buffer,
+                        bool denormalize = false);
+void WriteBracketString(Tree<string>* t, std::ostream& out,
+                        bool denormalize = false);
+
+#endif
@@ -34,6 +34,35 @@ vector<string> split(string str, char sep) {
   return tokens;
 }
 
+string WordSignature(string_view word) {
+  bool first_upper = !word.empty() && word[0] >= 'A' && word[0] <= 'Z';
+  bool all_upper = true, lower = true, digit = false, hyphen = false;
+  int n_letters = 0;
+  for (char c : word) {
+    if (c >= 'a' && c <= 'z') all_upper = false;
+    if (c >= 'A' && c <= 'Z') lower = false;
+    if (c >= '0' && c <= '9') digit = true;
+    if (c == '-') hyphen = true;
+    // UTF-8 continuation bytes do not start a letter
+    if ((c & 0xc0) != 0x80) n_letters++;
+  }
+  string signature = "<UNK";
+  if (first_upper) signature += all_upper && word.size() > 1 ? "-CAPS" : "-C";
+  if (digit) signature += "-d";
+  if (hyphen) signature += "-h";
+  if (lower && !digit && !hyphen && n_letters >= 5) {
+    // Last two letters (UTF-8 code points)
+    size_t start = word.size();
+    for (int letters = 0; letters < 2 && start > 0;) {
+      start--;
+      if ((word[start] & 0xc0) != 0x80) letters++;
+    }
+    signature += "-";
+    signature += word.substr(start);
+  }
+  signature += ">";
+  return signature;
+}
 
 tuple<int, char, string> ReadUntil(string s, int start, string stop_chars) {
   int i = start;
@@ -4,7 +4,9 @@
 #include <vector>
 #include <tuple>
 #include <string>
+#include <string_view>
 
+using std::string_view;
 using std::tuple;
 using std::vector;
 using std::string;
@@ -25,5 +27,11 @@ tuple<int, char, string> ReadUntil(string s, int start, string stop_chars);
 // Example: split("This is an example!", " ") --> {"This","is","an","example!"}
 vector<string> split(string str, char sep);
 
+// Class of an unknown word, from its shape:
+// capitalization, digits, hyphens and (for lower case words) the last two
+// letters. Example: WordSignature("relocalisation") --> "<UNK-on>",
+// WordSignature("Saint-Ouen") --> "<UNK-C-h>"
+string WordSignature(string_view word);
+
 
 #endif
\ No newline at end of file
@@ -5,8 +5,18 @@ from cyk import *
 
 from time import time
 import numpy as np
+import os
 import pickle
 import sys
+
+# The C++ engine (c++/python, build with 'python setup.py build_ext --inplace')
+# is used for parsing when available, the python CYK otherwise
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'c++', 'python'))
+try:
+    import pcfg_engine
+except ImportError:
+    pcfg_engine = None
+engine_grammar = None
  
 def parse(tokens, pcfg, embedding_idx, embeddings, simplify):
     
@@ -15,6 +25,14 @@ def parse(tokens, pcfg, embedding_idx, embeddings, simplify):
     
     # CYK parsing
     start = time()
+    if engine_grammar is not None:
+        # The OOV candidates form a word lattice
+        result = engine_grammar.parse_lattice(preprocessed_tokens)
+        if result is not None and result[0].startswith('( (SENT ('):
+            tree = sentence_to_tree(result[0])
+            if simplify:
+                tree.simplify()
+            return tree, result[1]
     tree, prob = CYK(preprocessed_tokens, pcfg)
     
     if tree is not None and simplify:
@@ -62,6 +80,9 @@ def initialize():
     print('Constructing pcfg')
     
     pcfg = create_pcfg(trees)
+    if pcfg_engine is not None:
+        global engine_grammar
+        engine_grammar = pcfg_engine.train(lines_train)
     print('Done\n')
     
     return pcfg, words, embeddings, embedding_idx